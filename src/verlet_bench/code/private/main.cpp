@@ -2,15 +2,20 @@
 #include <charconv>
 #include <chrono>
 #include <optional>
+#include <ranges>
 #include <span>
 #include <string>
 #include <string_view>
+#include <vector>
 
 #include "fmt/core.h"
 #include "fmt/os.h"
+#include "fmt/ranges.h"  // IWYU pragma: keep
 #include "klvk/error_handling.hpp"
+#include "magic_enum/magic_enum.hpp"
 #include "verlet/physics/verlet_solver.hpp"
 #include "verlet/random_objects.hpp"
+#include "verlet/threading/numa.hpp"
 
 namespace verlet
 {
@@ -29,7 +34,56 @@ struct Settings
     float density = 0.85f;
 
     float max_speed = 10.f;
+
+    // Mixed sizes: the share of every spawn that is big objects, and how big they are. Big
+    // objects take their own area out of the world, so the world grows with them to keep the
+    // density.
+    float big_share = 0.f;
+    float big_radius = 4.f;
+
+    // Substeps per frame; the common counts take the solver's builds specialized for them.
+    // Adaptive substeps start from it and pick their own.
+    size_t substeps = SolverConfig{}.substeps;
+    bool adaptive_substeps = false;
+
     size_t threads = 0;
+    Broadphase broadphase = Broadphase::CellChains;
+    CollisionKernel collision_kernel = CollisionKernels::Preferred();
+    CollisionStencil collision_stencil = CollisionStencil::Full;
+    CollisionIteration collision_iteration = CollisionIteration::GaussSeidel;
+    float jacobi_relaxation = 1.f;
+    bool sleeping = false;
+
+    // Bins the objects for the next substep as they are integrated; only incremental chains
+    // take it.
+    bool fused_binning = false;
+
+    // Runs every update as one batch whose threads wait for each pass at a spin barrier.
+    bool persistent_workers = false;
+
+    // Pins the solver's threads to cores, spread over the NUMA nodes. NUMA placement pins
+    // them too, and moves each stage's objects to the nodes of the threads that integrate
+    // them once the stage's first frame has built the grid.
+    bool pin = false;
+    bool numa = false;
+
+    // Asks for the pool's arrays to be backed by transparent huge pages.
+    bool huge_pages = false;
+
+    // Hands out ids through the pool's handle table, which keeps the live objects packed at
+    // the front of the arrays instead of leaving freed slots among them.
+    bool dense = false;
+
+    // Frames between two reorderings of the pool along the grid; zero keeps spawn order.
+    size_t reorder_period = 0;
+
+    // A rope of this many links runs instead of the growing crowd when it is not zero, once
+    // under every link model, with the links solved link_iterations times a substep and given
+    // link_compliance.
+    size_t rope_segments = 0;
+    size_t link_iterations = SolverConfig{}.link_iterations;
+    float link_compliance = 0.f;
+
     std::string_view out = "bench.csv";
 };
 
@@ -58,6 +112,148 @@ void ReadOption(std::span<char*> arguments, std::string_view name, T& destinatio
     klvk::ErrorHandling::Ensure(result.ec == std::errc{}, "{} expects a number, got {}", name, *text);
 }
 
+// How deep the objects of the cells still overlap, on average over the pairs that do: what the
+// collision passes left unsolved, for comparing how well two ways of solving converge.
+[[nodiscard]] double MeanOverlap(const VerletSolver& solver)
+{
+    const std::span positions = solver.objects.Positions();
+    const std::span radii = solver.objects.Radii();
+    double overlap = 0.;
+    size_t pairs = 0;
+    for (const size_t index : solver.objects.LiveSlots())
+    {
+        if (radii[index] > solver.GetMaxCellObjectRadius()) continue;
+
+        // The grid has a spare row and column past the far border of the area, but none before
+        // the near one.
+        const auto cell = solver.LocationToCell(positions[index]);
+        for (const size_t y : std::views::iota(cell.y() - std::min(cell.y(), size_t{1}), cell.y() + 2))
+        {
+            for (const size_t x : std::views::iota(cell.x() - std::min(cell.x(), size_t{1}), cell.x() + 2))
+            {
+                for (const uint32_t other_index : solver.ForEachIndexInCell(solver.CellToCellIndex({x, y})))
+                {
+                    if (other_index <= index) continue;
+
+                    const float depth =
+                        radii[index] + radii[other_index] - (positions[index] - positions[other_index]).Length();
+                    if (depth <= 0.f) continue;
+                    overlap += depth;
+                    ++pairs;
+                }
+            }
+        }
+    }
+
+    return pairs == 0 ? 0. : overlap / static_cast<double>(pairs);
+}
+
+void ReadOption(std::span<char*> arguments, std::string_view name, bool& destination)
+{
+    const auto text = Option(arguments, name);
+    if (!text) return;
+
+    klvk::ErrorHandling::Ensure(*text == "0" || *text == "1", "{} expects 0 or 1, got {}", name, *text);
+    destination = *text == "1";
+}
+
+template <typename T>
+    requires(std::is_enum_v<T>)
+void ReadOption(std::span<char*> arguments, std::string_view name, T& destination)
+{
+    const auto text = Option(arguments, name);
+    if (!text) return;
+
+    const auto value = magic_enum::enum_cast<T>(*text);
+    klvk::ErrorHandling::Ensure(
+        value.has_value(),
+        "{} expects one of {}, got {}",
+        name,
+        magic_enum::enum_names<T>(),
+        *text);
+    destination = *value;
+}
+
+// The rope hangs straight down from its top knot, every knot touching the next, and runs for a
+// window of frames under each link model from the same start. What the frames cost tells the
+// models apart on speed, and how far the rope has stretched under its own weight by the end on
+// how stiff they hold it for that cost.
+void RunRope(const Settings& settings)
+{
+    const auto length = static_cast<float>(settings.rope_segments);
+
+    auto csv = fmt::output_file(std::string{settings.out});
+    csv.print("link_model,segments,substeps,link_iterations,link_compliance,threads,total_ms,links_ms,stretch\n");
+
+    fmt::println(
+        "rope_segments={} window={} substeps={} link_iterations={} link_compliance={} sleeping={}",
+        settings.rope_segments,
+        settings.window,
+        settings.substeps,
+        settings.link_iterations,
+        settings.link_compliance,
+        settings.sleeping);
+    fmt::println("{:>10} {:>9} {:>9} {:>9}", "model", "total", "links", "stretch");
+
+    for (const auto link_model : magic_enum::enum_values<LinkModel>())
+    {
+        VerletSolver solver;
+        auto config = solver.GetConfig();
+        config.substeps = settings.substeps;
+        config.link_model = link_model;
+        config.link_iterations = settings.link_iterations;
+        config.link_compliance = settings.link_compliance;
+        solver.SetConfig(config);
+        solver.SetSimArea({.x = {.begin = -8.f, .end = 8.f}, .y = {.begin = -length - 8.f, .end = 8.f}});
+        if (settings.threads != 0) solver.SetThreadsCount(settings.threads);
+        solver.SetSleepingEnabled(settings.sleeping);
+
+        std::vector<ObjectId> knots;
+        for (const size_t knot : std::views::iota(size_t{0}, settings.rope_segments + 1))
+        {
+            auto [id, object] = solver.objects.Alloc();
+            object.position = {0.f, -static_cast<float>(knot) * 2 * kDefaultObjectRadius};
+            object.old_position = object.position;
+            object.radius = kDefaultObjectRadius;
+            object.movable = knot != 0;
+            if (!knots.empty()) solver.CreateLink(knots.back(), id, 2 * kDefaultObjectRadius);
+            knots.push_back(id);
+        }
+
+        VerletSolver::UpdateStats sum{};
+        for ([[maybe_unused]] const size_t frame : std::views::iota(size_t{0}, settings.window))
+        {
+            const auto stats = solver.Update();
+            sum.total += stats.total;
+            sum.apply_links += stats.apply_links;
+        }
+
+        const auto frames = static_cast<double>(settings.window);
+        const float hanging =
+            solver.objects.Get(knots.front()).position.y() - solver.objects.Get(knots.back()).position.y();
+        const float stretch = hanging / (length * 2 * kDefaultObjectRadius);
+        csv.print(
+            "{},{},{},{},{},{},{:.4f},{:.4f},{:.4f}\n",
+            magic_enum::enum_name(link_model),
+            settings.rope_segments,
+            settings.substeps,
+            settings.link_iterations,
+            settings.link_compliance,
+            solver.GetThreadsCount(),
+            Milliseconds(sum.total) / frames,
+            Milliseconds(sum.apply_links) / frames,
+            stretch);
+        csv.flush();
+
+        fmt::println(
+            "{:>10} {:>9.3f} {:>9.3f} {:>9.4f}",
+            magic_enum::enum_name(link_model),
+            Milliseconds(sum.total) / frames,
+            Milliseconds(sum.apply_links) / frames,
+            stretch);
+    }
+}
+
 void Main(int argc, char** argv)
 {
     const std::span arguments{argv, static_cast<size_t>(argc)};
@@ -69,72 +265,247 @@ void Main(int argc, char** argv)
     ReadOption(arguments, "--seed", settings.seed);
     ReadOption(arguments, "--density", settings.density);
     ReadOption(arguments, "--max-speed", settings.max_speed);
+    ReadOption(arguments, "--big-share", settings.big_share);
+    ReadOption(arguments, "--big-radius", settings.big_radius);
+    ReadOption(arguments, "--substeps", settings.substeps);
+    ReadOption(arguments, "--adaptive-substeps", settings.adaptive_substeps);
     ReadOption(arguments, "--threads", settings.threads);
+    ReadOption(arguments, "--broadphase", settings.broadphase);
+    ReadOption(arguments, "--collision-kernel", settings.collision_kernel);
+    ReadOption(arguments, "--collision-stencil", settings.collision_stencil);
+    ReadOption(arguments, "--collision-iteration", settings.collision_iteration);
+    ReadOption(arguments, "--jacobi-relaxation", settings.jacobi_relaxation);
+    ReadOption(arguments, "--sleeping", settings.sleeping);
+    ReadOption(arguments, "--fused-binning", settings.fused_binning);
+    ReadOption(arguments, "--persistent-workers", settings.persistent_workers);
+    ReadOption(arguments, "--pin", settings.pin);
+    ReadOption(arguments, "--numa", settings.numa);
+    ReadOption(arguments, "--huge-pages", settings.huge_pages);
+    ReadOption(arguments, "--dense", settings.dense);
+    ReadOption(arguments, "--reorder-period", settings.reorder_period);
+    ReadOption(arguments, "--rope-segments", settings.rope_segments);
+    ReadOption(arguments, "--link-iterations", settings.link_iterations);
+    ReadOption(arguments, "--link-compliance", settings.link_compliance);
     if (const auto out = Option(arguments, "--out")) settings.out = *out;
 
-    const auto world = 0.5f * std::sqrt(static_cast<float>(settings.max_objects) / settings.density);
+    settings.pin = settings.pin || settings.numa;
+
+    if (settings.rope_segments != 0)
+    {
+        RunRope(settings);
+        return;
+    }
+
+    klvk::ErrorHandling::Ensure(
+        settings.big_share >= 0.f && settings.big_share <= 1.f,
+        "--big-share expects a share between 0 and 1, got {}",
+        settings.big_share);
+
+    // A small object takes up a cell; a big one the square around it.
+    const float area_per_object =
+        1.f - settings.big_share + settings.big_share * edt::Math::Sqr(2 * settings.big_radius);
+    const auto world =
+        0.5f * std::sqrt(static_cast<float>(settings.max_objects) * area_per_object / settings.density);
 
     VerletSolver solver;
+    klvk::ErrorHandling::Ensure(
+        settings.big_radius > 0.f && settings.big_radius <= solver.GetMaxObjectRadius(),
+        "--big-radius expects a radius up to {}, got {}",
+        solver.GetMaxObjectRadius(),
+        settings.big_radius);
+
+    auto config = solver.GetConfig();
+    config.substeps = settings.substeps;
+    config.adaptive_substeps = settings.adaptive_substeps;
+    solver.SetConfig(config);
     solver.SetSimArea({.x = {.begin = -world, .end = world}, .y = {.begin = -world, .end = world}});
+    solver.SetThreadPinningEnabled(settings.pin);
     if (settings.threads != 0) solver.SetThreadsCount(settings.threads);
+    solver.SetBroadphase(settings.broadphase);
+    solver.SetCollisionKernel(settings.collision_kernel);
+    solver.SetCollisionStencil(settings.collision_stencil);
+    solver.SetCollisionIteration(settings.collision_iteration);
+    solver.SetJacobiRelaxation(settings.jacobi_relaxation);
+    solver.SetSleepingEnabled(settings.sleeping);
+    solver.SetFusedBinningEnabled(settings.fused_binning);
+    solver.SetPersistentWorkersEnabled(settings.persistent_workers);
+    solver.SetNumaPlacementEnabled(settings.numa);
+    solver.objects.SetHugePagesEnabled(settings.huge_pages);
+    solver.objects.SetDenseEnabled(settings.dense);
 
     auto csv = fmt::output_file(std::string{settings.out});
-    csv.print("objects,cells,threads,total_ms,rebuild_ms,solve_ms,positions_ms\n");
+    csv.print(
+        "objects,cells,threads,broadphase,collision_kernel,collision_stencil,collision_iteration,jacobi_relaxation,"
+        "sleeping,fused_binning,persistent_workers,pin,numa,numa_pages,numa_placed_pages,huge_pages,dense,spawn_ms,"
+        "total_ms,rebuild_ms,solve_ms,positions_ms,integrate_and_bin_ms,barrier_wait_ms,reorder_ms,sleeping_objects,"
+        "substeps,mean_overlap,substep_bytes_per_object,bytes_per_object\n");
 
     fmt::println(
-        "step={} window={} seed={} density={} max_speed={} world={:.0f} threads={}",
+        "step={} window={} seed={} density={} max_speed={} big_share={} big_radius={} world={:.0f} substeps={} "
+        "adaptive_substeps={} threads={} broadphase={} collision_kernel={} collision_stencil={} "
+        "collision_iteration={} jacobi_relaxation={} sleeping={} fused_binning={} persistent_workers={} pin={} "
+        "numa={} numa_nodes={} huge_pages={} dense={} reorder_period={} substep_bytes_per_slot={} bytes_per_slot={}",
         settings.step,
         settings.window,
         settings.seed,
         settings.density,
         settings.max_speed,
+        settings.big_share,
+        settings.big_radius,
         world,
-        solver.GetThreadsCount());
-    fmt::println("{:>9} {:>9} {:>9} {:>9} {:>9}", "objects", "total", "rebuild", "solve", "positions");
+        settings.substeps,
+        settings.adaptive_substeps,
+        solver.GetThreadsCount(),
+        magic_enum::enum_name(settings.broadphase),
+        magic_enum::enum_name(settings.collision_kernel),
+        magic_enum::enum_name(settings.collision_stencil),
+        magic_enum::enum_name(settings.collision_iteration),
+        settings.jacobi_relaxation,
+        settings.sleeping,
+        settings.fused_binning,
+        settings.persistent_workers,
+        settings.pin,
+        settings.numa,
+        NumaTopology::Get().NodesCount(),
+        settings.huge_pages,
+        settings.dense,
+        settings.reorder_period,
+        ObjectPool::SubStepBytesPerSlot(),
+        solver.objects.BytesPerSlot());
+    fmt::println(
+        "{:>9} {:>9} {:>9} {:>9} {:>9} {:>9} {:>9} {:>9} {:>9} {:>9} {:>9} {:>9}",
+        "objects",
+        "spawn",
+        "total",
+        "rebuild",
+        "solve",
+        "positions",
+        "int+bin",
+        "wait",
+        "reorder",
+        "sleeping",
+        "substeps",
+        "overlap");
 
     uint32_t stage = 0;
+    size_t frames_run = 0;
     while (solver.objects.ObjectsCount() < settings.max_objects)
     {
-        SpawnRandomObjects(
-            solver,
+        const size_t count = std::min(settings.step, settings.max_objects - solver.objects.ObjectsCount());
+        const auto big_count = static_cast<size_t>(static_cast<float>(count) * settings.big_share);
+        const auto spawn = edt::MeasureTime(
+            [&]
             {
-                .count = std::min(settings.step, settings.max_objects - solver.objects.ObjectsCount()),
-                .seed = settings.seed + stage,
-                .max_speed = settings.max_speed,
-                .movable = true,
+                SpawnRandomObjects(
+                    solver,
+                    {
+                        .count = count - big_count,
+                        .seed = settings.seed + stage,
+                        .max_speed = settings.max_speed,
+                        .movable = true,
+                    });
+                SpawnRandomObjects(
+                    solver,
+                    {
+                        .count = big_count,
+                        .seed = ~(settings.seed + stage),
+                        .max_speed = settings.max_speed,
+                        .radius = settings.big_radius,
+                        .movable = true,
+                    });
             });
         ++stage;
 
         VerletSolver::UpdateStats sum{};
-        for ([[maybe_unused]] const size_t frame : std::views::iota(size_t{0}, settings.window))
+        std::chrono::nanoseconds reorder{};
+        size_t sleeping_objects = 0;
+        size_t substeps = 0;
+        PagePlacement numa_placement;
+        for (const size_t frame : std::views::iota(size_t{0}, settings.window))
         {
             const auto stats = solver.Update();
             sum.total += stats.total;
             sum.rebuild_grid += stats.rebuild_grid;
             sum.solve_collisions += stats.solve_collisions;
             sum.update_positions += stats.update_positions;
+            sum.integrate_and_bin += stats.integrate_and_bin;
+            sum.barrier_wait += stats.barrier_wait;
+            sleeping_objects = stats.sleeping_objects;
+            substeps += stats.substeps;
+
+            if (settings.numa && frame == 0) numa_placement = solver.PlaceOnNumaNodes();
+
+            ++frames_run;
+            if (settings.reorder_period != 0 && frames_run % settings.reorder_period == 0)
+            {
+                reorder += edt::MeasureTime([&] { std::ignore = solver.ReorderObjects(); });
+            }
         }
 
         const auto frames = static_cast<double>(settings.window);
         const auto objects = solver.objects.ObjectsCount();
+        const double overlap = MeanOverlap(solver);
+
+        // Freed slots take their bytes in every array all the same, and passes that walk the
+        // slots rather than the cells stream them.
+        const double slots_per_object =
+            static_cast<double>(solver.objects.SlotsCount()) / static_cast<double>(objects);
         csv.print(
-            "{},{},{},{:.4f},{:.4f},{:.4f},{:.4f}\n",
+            "{},{},{},{},{},{},{},{},{:d},{:d},{:d},{:d},{:d},{},{},{:d},{:d},{:.4f},"
+            "{:.4f},{:.4f},{:.4f},{:.4f},{:.4f},{:.4f},{:.4f},{},{:.2f},{:.6f},{:.2f},{:.2f}\n",
             objects,
             solver.GetGridCellsCount(),
             solver.GetThreadsCount(),
+            magic_enum::enum_name(settings.broadphase),
+            magic_enum::enum_name(settings.collision_kernel),
+            magic_enum::enum_name(settings.collision_stencil),
+            magic_enum::enum_name(settings.collision_iteration),
+            settings.jacobi_relaxation,
+            settings.sleeping,
+            settings.fused_binning,
+            settings.persistent_workers,
+            settings.pin,
+            settings.numa,
+            numa_placement.pages,
+            numa_placement.placed_pages,
+            settings.huge_pages,
+            settings.dense,
+            Milliseconds(spawn),
             Milliseconds(sum.total) / frames,
             Milliseconds(sum.rebuild_grid) / frames,
             Milliseconds(sum.solve_collisions) / frames,
-            Milliseconds(sum.update_positions) / frames);
+            Milliseconds(sum.update_positions) / frames,
+            Milliseconds(sum.integrate_and_bin) / frames,
+            Milliseconds(sum.barrier_wait) / frames,
+            Milliseconds(reorder) / frames,
+            sleeping_objects,
+            static_cast<double>(substeps) / frames,
+            overlap,
+            static_cast<double>(ObjectPool::SubStepBytesPerSlot()) * slots_per_object,
+            static_cast<double>(solver.objects.BytesPerSlot()) * slots_per_object);
         csv.flush();
 
         fmt::println(
-            "{:>9} {:>9.3f} {:>9.3f} {:>9.3f} {:>9.3f}",
+            "{:>9} {:>9.3f} {:>9.3f} {:>9.3f} {:>9.3f} {:>9.3f} {:>9.3f} {:>9.3f} {:>9.3f} {:>9} {:>9.2f} {:>9.5f}",
             objects,
+            Milliseconds(spawn),
             Milliseconds(sum.total) / frames,
             Milliseconds(sum.rebuild_grid) / frames,
             Milliseconds(sum.solve_collisions) / frames,
-            Milliseconds(sum.update_positions) / frames);
+            Milliseconds(sum.update_positions) / frames,
+            Milliseconds(sum.integrate_and_bin) / frames,
+            Milliseconds(sum.barrier_wait) / frames,
+            Milliseconds(reorder) / frames,
+            sleeping_objects,
+            static_cast<double>(substeps) / frames,
+            overlap);
+
+        // Placement that the system refused, or that had a single node to place on, would
+        // otherwise look the same as placement that worked.
+        if (settings.numa)
+        {
+            fmt::println("{:>9} numa placed {} of {} pages", "", numa_placement.placed_pages, numa_placement.pages);
+        }
     }
 }
 
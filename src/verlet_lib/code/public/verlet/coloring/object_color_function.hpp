@@ -2,9 +2,9 @@
 #include <functional>
 
 #include "edt/math/matrix.hpp"
+#include "verlet/object.hpp"
 
 namespace verlet
 {
-class VerletObject;
-using ObjectColorFunction = std::function<edt::Vec4<uint8_t>(const VerletObject&)>;
+using ObjectColorFunction = std::function<edt::Vec4<uint8_t>(ConstVerletObject)>;
 }  // namespace verlet
@@ -4,7 +4,7 @@ namespace verlet
 {
 [[nodiscard]] ObjectColorFunction SpawnColorStrategyArray ::GetColorFunction()
 {
-    return [this]([[maybe_unused]] const VerletObject& object)
+    return [this]([[maybe_unused]] const ConstVerletObject object)
     {
         edt::Vec4<uint8_t> c{colors[index].x(), colors[index].y(), colors[index].z(), 255};
 
@@ -6,7 +6,7 @@ namespace verlet
 {
 [[nodiscard]] ObjectColorFunction SpawnColorStrategyRainbow ::GetColorFunction()
 {
-    return [t = phase_ + frequency_ * GetApp().GetTimeSeconds()]([[maybe_unused]] const VerletObject& object)
+    return [t = phase_ + frequency_ * GetApp().GetTimeSeconds()]([[maybe_unused]] const ConstVerletObject object)
     {
         auto rgb = edt::Math::GetRainbowColors(t);
         Vec4<uint8_t> c;
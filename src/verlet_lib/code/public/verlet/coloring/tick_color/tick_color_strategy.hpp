@@ -13,6 +13,9 @@ public:
     explicit TickColorStrategy(VerletApp& app) : app_{&app} {}
     virtual ~TickColorStrategy() = default;
 
+    // The function is called from the solver's threads at once, for a share of the objects
+    // each, every frame. It must not change anything it shares between calls, unlike a spawn
+    // color function, which is called for one object at a time and can count what it colored.
     virtual ObjectColorFunction GetColorFunction() = 0;
     [[nodiscard]] virtual const refl::Type& GetType() const = 0;
     virtual void DrawGUI() {}
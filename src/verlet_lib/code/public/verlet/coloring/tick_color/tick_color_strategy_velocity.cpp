@@ -3,15 +3,16 @@
 #include "imgui.h"
 #include "verlet/object.hpp"
 #include "verlet/physics/verlet_solver.hpp"
+#include "verlet/verlet_app.hpp"
 
 namespace verlet
 {
 
 ObjectColorFunction TickColorStrategyVelocity ::GetColorFunction()
 {
-    return [this](const VerletObject& object)
+    return [this, time_step = GetApp().solver.GetConfig().time_step_seconds](const ConstVerletObject object)
     {
-        const float speed = ((object.position - object.old_position) / VerletSolver::kTimeStepDurationSeconds).Length();
+        const float speed = ((object.position - object.old_position) / time_step).Length();
         const float fraction = std::clamp(speed / red_speed_, 0.f, 1.f);
         return Gradient(fraction);
     };
@@ -44,7 +44,7 @@ void FlatEmitter::Tick(VerletApp& app)
 
     // Spacing is the gap between neighbours in object diameters, so zero puts
     // them exactly one diameter apart: touching.
-    constexpr float diameter = 2 * VerletObject::GetRadius();
+    constexpr float diameter = 2 * kDefaultObjectRadius;
     const float step_length = diameter * (1.f + std::max(config.spacing, 0.f));
     // A surface too short to hold two objects still emits one, otherwise it would
     // silently produce nothing at all.
@@ -58,12 +58,13 @@ void FlatEmitter::Tick(VerletApp& app)
 
     auto color_fn = app.spawn_color_strategy_->GetColorFunction();
 
+    const auto objects = app.solver.objects.AllocBatch(count);
     for (const size_t index : std::views::iota(size_t{0}, count))
     {
         const Vec2f origin = start + step * (static_cast<float>(index) + 0.5f);
 
-        auto [id, object] = app.solver.objects.Alloc();
-        object.position = origin + direction * (config.speed_factor * VerletSolver::kTimeStepDurationSeconds);
+        const VerletObject& object = std::get<1>(objects[index]);
+        object.position = origin + direction * (config.speed_factor * app.solver.GetConfig().time_step_seconds);
         object.old_position = origin;
         object.movable = true;
         object.color = color_fn(object);
@@ -33,11 +33,12 @@ void RadialEmitter::Tick(VerletApp& app)
     // one, otherwise it silently produces nothing at all.
     const auto num_directions = std::max(
         size_t{1},
-        static_cast<size_t>(sector_radians * (radius + VerletObject::GetRadius()) / (2 * VerletObject::GetRadius())));
+        static_cast<size_t>(sector_radians * (radius + kDefaultObjectRadius) / (2 * kDefaultObjectRadius)));
     const float phase_radians = sector_radians / 2 + edt::Math::DegToRad(state.phase_degrees);
 
     auto color_fn = app.spawn_color_strategy_->GetColorFunction();
 
+    const auto objects = app.solver.objects.AllocBatch(num_directions);
     for (size_t i : std::views::iota(size_t{0}, num_directions))
     {
         auto matrix = edt::Math::RotationMatrix2d(
@@ -45,9 +46,9 @@ void RadialEmitter::Tick(VerletApp& app)
         auto v = edt::Math::TransformVector(matrix, Vec2f::AxisY());
 
         Vec2f old_pos = origin + radius * v;
-        Vec2f new_pos = origin + (radius + config.speed_factor * VerletSolver::kTimeStepDurationSeconds) * v;
+        Vec2f new_pos = origin + (radius + config.speed_factor * app.solver.GetConfig().time_step_seconds) * v;
 
-        auto [id, object] = app.solver.objects.Alloc();
+        const VerletObject& object = std::get<1>(objects[i]);
         object.position = new_pos;
         object.old_position = old_pos;
         object.movable = true;
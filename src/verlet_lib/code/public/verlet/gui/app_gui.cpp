@@ -7,6 +7,7 @@
 #include "klvk/platform/file_dialog.hpp"
 #include "klvk/ui/imgui_helpers.hpp"
 #include "klvk/ui/simple_type_widget.hpp"
+#include "magic_enum/magic_enum.hpp"
 #include "verlet/coloring/spawn_color/spawn_color_strategy.hpp"
 #include "verlet/coloring/spawn_color/spawn_color_strategy_rainbow.hpp"
 #include "verlet/coloring/tick_color/tick_color_strategy.hpp"
@@ -14,6 +15,7 @@
 #include "verlet/emitters/emitter.hpp"
 #include "verlet/emitters/flat_emitter.hpp"
 #include "verlet/emitters/radial_emitter.hpp"
+#include "verlet/object.hpp"
 #include "verlet/tools/delete_objects_tool.hpp"
 #include "verlet/tools/move_objects_tool.hpp"
 #include "verlet/tools/spawn_objects_tool.hpp"
@@ -122,6 +124,7 @@ void AppGUI::Render()
         SpawnColors();
         TickColors();
         CollisionsSolver();
+        Simulation();
         Stats();
     }
     ImGui::End();
@@ -161,11 +164,15 @@ void AppGUI::Perf()
     const auto& stats = app_->GetPerfStats();
     GuiText("Framerate: {}", app_->GetFramerate());
     GuiText("Objects count: {}", app_->solver.objects.ObjectsCount());
+    GuiText("Sleeping objects: {}", stats.sim_update.sleeping_objects);
+    GuiText("Substeps: {}", stats.sim_update.substeps);
     GuiText("Sim update {}", to_flt_ms(stats.sim_update.total));
     GuiText("  Apply links {}", to_flt_ms(stats.sim_update.apply_links));
     GuiText("  Rebuild grid {}", to_flt_ms(stats.sim_update.rebuild_grid));
     GuiText("  Solve collisions {}", to_flt_ms(stats.sim_update.solve_collisions));
     GuiText("  Update positions {}", to_flt_ms(stats.sim_update.update_positions));
+    GuiText("  Integrate and bin {}", to_flt_ms(stats.sim_update.integrate_and_bin));
+    GuiText("  Longest barrier wait {}", to_flt_ms(stats.sim_update.barrier_wait));
     GuiText("Render {}", to_flt_ms(stats.render.total));
     GuiText("  Set Circle Loop {}", to_flt_ms(stats.render.set_circle_loop));
 }
@@ -348,6 +355,127 @@ void AppGUI::CollisionsSolver()
         size_t{std::thread::hardware_concurrency()},
         std::bind_front(&VerletSolver::GetThreadsCount, &app_->solver),
         std::bind_front(&VerletSolver::SetThreadsCount, &app_->solver));
+    klvk::ImGuiHelper::SliderUInt("Reorder period (frames)", &app_->objects_reorder_period_, size_t{0}, size_t{600});
+
+    GuiText("Broadphase");
+    for (const auto& [broadphase, name] : magic_enum::enum_entries<Broadphase>())
+    {
+        ImGui::SameLine();
+        if (ImGui::RadioButton(name.data(), app_->solver.GetBroadphase() == broadphase))
+        {
+            app_->solver.SetBroadphase(broadphase);
+        }
+    }
+
+    if (bool sleeping = app_->solver.IsSleepingEnabled(); ImGui::Checkbox("Let settled tiles sleep", &sleeping))
+    {
+        app_->solver.SetSleepingEnabled(sleeping);
+    }
+
+    // Only incremental chains can take the cells found while integrating.
+    if (bool fused = app_->solver.IsFusedBinningEnabled(); ImGui::Checkbox("Bin while integrating", &fused))
+    {
+        app_->solver.SetFusedBinningEnabled(fused);
+    }
+
+    if (bool persistent = app_->solver.IsPersistentWorkersEnabled();
+        ImGui::Checkbox("Keep workers through the update", &persistent))
+    {
+        app_->solver.SetPersistentWorkersEnabled(persistent);
+    }
+
+    if (bool pinned = app_->solver.IsThreadPinningEnabled(); ImGui::Checkbox("Pin threads to cores", &pinned))
+    {
+        app_->solver.SetThreadPinningEnabled(pinned);
+    }
+
+    if (bool huge = app_->solver.objects.IsHugePagesEnabled(); ImGui::Checkbox("Huge pages for objects", &huge))
+    {
+        app_->solver.objects.SetHugePagesEnabled(huge);
+    }
+
+    // The pool only switches how it hands out ids while it is empty, so this starts the scene over.
+    if (bool dense = app_->solver.objects.IsDenseEnabled(); ImGui::Checkbox("Dense objects (clears the scene)", &dense))
+    {
+        app_->solver.DeleteAll();
+        app_->solver.objects.SetDenseEnabled(dense);
+    }
+
+    GuiText("Collision stencil");
+    for (const auto& [stencil, name] : magic_enum::enum_entries<CollisionStencil>())
+    {
+        ImGui::SameLine();
+        if (ImGui::RadioButton(name.data(), app_->solver.GetCollisionStencil() == stencil))
+        {
+            app_->solver.SetCollisionStencil(stencil);
+        }
+    }
+
+    GuiText("Collision iteration");
+    for (const auto& [iteration, name] : magic_enum::enum_entries<CollisionIteration>())
+    {
+        ImGui::SameLine();
+        if (ImGui::RadioButton(name.data(), app_->solver.GetCollisionIteration() == iteration))
+        {
+            app_->solver.SetCollisionIteration(iteration);
+        }
+    }
+
+    if (float relaxation = app_->solver.GetJacobiRelaxation();
+        app_->solver.GetCollisionIteration() == CollisionIteration::Jacobi &&
+        ImGui::SliderFloat("Jacobi relaxation", &relaxation, 0.1f, 1.9f))
+    {
+        app_->solver.SetJacobiRelaxation(relaxation);
+    }
+}
+
+void AppGUI::Simulation()
+{
+    if (!ImGui::CollapsingHeader("Simulation")) return;
+
+    auto config = app_->solver.GetConfig();
+    const auto& current = app_->solver.GetConfig();
+    klvk::ImGuiHelper::SliderUInt("Substeps", &config.substeps, size_t{1}, size_t{16});
+    bool changed = config.substeps != current.substeps;
+    changed |= ImGui::Checkbox("Adaptive substeps", &config.adaptive_substeps);
+    if (config.adaptive_substeps)
+    {
+        klvk::ImGuiHelper::SliderUInt("Min substeps", &config.min_substeps, size_t{1}, size_t{16});
+        klvk::ImGuiHelper::SliderUInt("Max substeps", &config.max_substeps, config.min_substeps, size_t{16});
+        config.max_substeps = std::max(config.max_substeps, config.min_substeps);
+        changed |= config.min_substeps != current.min_substeps || config.max_substeps != current.max_substeps;
+        changed |= ImGui::SliderFloat("Max substep move", &config.max_substep_move, 0.05f, 1.f);
+    }
+
+    GuiText("Link model");
+    for (const auto& [link_model, name] : magic_enum::enum_entries<LinkModel>())
+    {
+        ImGui::SameLine();
+        if (ImGui::RadioButton(name.data(), config.link_model == link_model))
+        {
+            config.link_model = link_model;
+            changed = true;
+        }
+    }
+    klvk::ImGuiHelper::SliderUInt("Link iterations", &config.link_iterations, size_t{1}, size_t{32});
+    changed |= config.link_iterations != current.link_iterations;
+
+    // Only links made from now on take it.
+    changed |= ImGui::SliderFloat(
+        "Link compliance",
+        &config.link_compliance,
+        0.f,
+        1e-2f,
+        "%.6f",
+        ImGuiSliderFlags_Logarithmic);
+
+    changed |= ImGui::SliderFloat("Velocity damping", &config.velocity_damping, 0.f, 100.f);
+    changed |= klvk::SimpleTypeWidget("Gravity", config.gravity);
+
+    // Cells smaller than the objects spawned would put every one of them in a coarse level.
+    changed |= ImGui::SliderFloat("Cell size", &config.cell_size, 2 * kDefaultObjectRadius, 4.f);
+    if (changed) app_->solver.SetConfig(config);
+    GuiText("Largest object radius: {}", app_->solver.GetMaxObjectRadius());
 }
 
 void AppGUI::Stats()
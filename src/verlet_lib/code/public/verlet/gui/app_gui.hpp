@@ -27,6 +27,7 @@ public:
     void SpawnColors();
     void TickColors();
     void CollisionsSolver();
+    void Simulation();
     void Stats();
 
     template <typename... Args>
@@ -8,6 +8,7 @@
 #include "verlet/emitters/flat_emitter.hpp"
 #include "verlet/emitters/radial_emitter.hpp"
 #include "verlet/json/json_keys.hpp"
+#include "verlet/physics/solver_config.hpp"
 #include "verlet/verlet_app.hpp"
 
 namespace verlet
@@ -31,6 +32,7 @@ class JSONHelpers::Internal
 {
 public:
     static constexpr auto kEmitterTypeParseMap = MakeEnumParseMap<EmitterType>();
+    static constexpr auto kLinkModelParseMap = MakeEnumParseMap<LinkModel>();
 
     template <typename Map>
         requires(std::same_as<typename Map::Key, std::string_view> && std::is_enum_v<typename Map::Value>)
@@ -258,6 +260,54 @@ std::unique_ptr<Emitter> JSONHelpers::EmitterFromJSON(const nlohmann::json& json
     }
 }
 
+nlohmann::json JSONHelpers::SolverConfigToJSON(const SolverConfig& config)
+{
+    nlohmann::json json;
+
+    json[JSONKeys::kTimeStepSeconds] = config.time_step_seconds;
+    json[JSONKeys::kSubSteps] = config.substeps;
+    json[JSONKeys::kAdaptiveSubSteps] = config.adaptive_substeps;
+    json[JSONKeys::kMinSubSteps] = config.min_substeps;
+    json[JSONKeys::kMaxSubSteps] = config.max_substeps;
+    json[JSONKeys::kMaxSubStepMove] = config.max_substep_move;
+    json[JSONKeys::kLinkModel] = magic_enum::enum_name(config.link_model);
+    json[JSONKeys::kLinkIterations] = config.link_iterations;
+    json[JSONKeys::kLinkCompliance] = config.link_compliance;
+    json[JSONKeys::kVelocityDamping] = config.velocity_damping;
+    json[JSONKeys::kGravity] = VectorToJSON(config.gravity);
+    json[JSONKeys::kCellSize] = config.cell_size;
+
+    return json;
+}
+
+SolverConfig JSONHelpers::SolverConfigFromJSON(const nlohmann::json& json)
+{
+    SolverConfig c{};
+
+    c.time_step_seconds = Internal::GetKey<float>(json, JSONKeys::kTimeStepSeconds);
+    auto get_count = [&](const std::string_view& key)
+    {
+        const int count = Internal::GetKey<int>(json, key);
+        klvk::ErrorHandling::Ensure(count > 0, "{} must be positive, got {}", key, count);
+        return static_cast<size_t>(count);
+    };
+
+    c.substeps = get_count(JSONKeys::kSubSteps);
+    c.adaptive_substeps = Internal::GetKey<bool>(json, JSONKeys::kAdaptiveSubSteps);
+    c.min_substeps = get_count(JSONKeys::kMinSubSteps);
+    c.max_substeps = get_count(JSONKeys::kMaxSubSteps);
+    c.max_substep_move = Internal::GetKey<float>(json, JSONKeys::kMaxSubStepMove);
+    c.link_model =
+        Internal::ParseEnum(Internal::kLinkModelParseMap, Internal::GetKey<std::string>(json, JSONKeys::kLinkModel));
+    c.link_iterations = get_count(JSONKeys::kLinkIterations);
+    c.link_compliance = Internal::GetKey<float>(json, JSONKeys::kLinkCompliance);
+    c.velocity_damping = Internal::GetKey<float>(json, JSONKeys::kVelocityDamping);
+    c.gravity = Vec2fFromJSON(GetKey(json, JSONKeys::kGravity));
+    c.cell_size = Internal::GetKey<float>(json, JSONKeys::kCellSize);
+
+    return c;
+}
+
 nlohmann::json JSONHelpers::AppStateToJSON(const VerletApp& app)
 {
     nlohmann::json json;
@@ -270,6 +320,7 @@ nlohmann::json JSONHelpers::AppStateToJSON(const VerletApp& app)
     {
         json[JSONKeys::kMaxObjectsCount] = app.max_objects_count_;
     }
+    json[JSONKeys::kSolver] = SolverConfigToJSON(app.solver.GetConfig());
     json[JSONKeys::kEmitters] = nlohmann::json::array();
 
     auto& array = json[JSONKeys::kEmitters];
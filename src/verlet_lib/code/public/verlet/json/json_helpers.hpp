@@ -10,6 +10,7 @@ class VerletApp;
 class Emitter;
 class RadialEmitterConfig;
 class FlatEmitterConfig;
+struct SolverConfig;
 
 class JSONHelpers
 {
@@ -32,6 +33,9 @@ public:
     static nlohmann::json EmitterToJSON(const Emitter& emitter);
     static std::unique_ptr<Emitter> EmitterFromJSON(const nlohmann::json& json);
 
+    static nlohmann::json SolverConfigToJSON(const SolverConfig& config);
+    static SolverConfig SolverConfigFromJSON(const nlohmann::json& json);
+
     static nlohmann::json AppStateToJSON(const VerletApp& app);
 };
 }  // namespace verlet
@@ -26,6 +26,19 @@ public:
     static constexpr std::string_view kMaxObjectsCount = "MaxObjectsCount";
     static constexpr std::string_view kMaxObjectsSaturation = "MaxObjectsSaturation";
     static constexpr std::string_view kRotationSpeed = "RotationSpeed";
+    static constexpr std::string_view kSolver = "Solver";
+    static constexpr std::string_view kTimeStepSeconds = "TimeStepSeconds";
+    static constexpr std::string_view kSubSteps = "SubSteps";
+    static constexpr std::string_view kAdaptiveSubSteps = "AdaptiveSubSteps";
+    static constexpr std::string_view kMinSubSteps = "MinSubSteps";
+    static constexpr std::string_view kMaxSubSteps = "MaxSubSteps";
+    static constexpr std::string_view kMaxSubStepMove = "MaxSubStepMove";
+    static constexpr std::string_view kLinkModel = "LinkModel";
+    static constexpr std::string_view kLinkIterations = "LinkIterations";
+    static constexpr std::string_view kLinkCompliance = "LinkCompliance";
+    static constexpr std::string_view kVelocityDamping = "VelocityDamping";
+    static constexpr std::string_view kGravity = "Gravity";
+    static constexpr std::string_view kCellSize = "CellSize";
 };
 
 }  // namespace verlet
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <limits>
+#include <type_traits>
 
 #include "edt/math/matrix.hpp"
 #include "edt/template/tagged_identifier.hpp"
@@ -15,30 +16,55 @@ static constexpr auto kInvalidObjectId = ObjectId{};
 
 static constexpr uint32_t kInvalidObjectIndex = std::numeric_limits<uint32_t>::max();
 
-class VerletObject
+// What an object is spawned with unless it is given a size of its own. Two of these just fit
+// side by side in a cell of the grid.
+static constexpr float kDefaultObjectRadius = 0.5f;
+
+// What an object is besides where it is: nothing a collision or an integration step looks
+// at, except whether the object may be moved at all.
+struct ObjectFlags
 {
-public:
-    VerletObject() = default;
-    VerletObject(const VerletObject&) = delete;
+    bool movable = false;
+    bool alive = false;
+};
 
-    Vec2f position{};
-    Vec2f old_position{};
+// The pool keeps each field of its objects in an array of its own, so no object is
+// anywhere in memory as a whole. This is what stands in for one: references to its fields,
+// valid until the object is freed or the pool is compacted or reordered. Naming a field
+// costs nothing until it is read, so a loop that only touches positions only streams
+// positions.
+template <bool kIsConst>
+class BasicVerletObject
+{
+    template <typename T>
+    using Field = std::conditional_t<kIsConst, const T, T>&;
 
-    // The object a grid cell hands out after this one. A cell holds the first of a chain
-    // rather than a fixed number of slots, so however many objects crowd into one they all
-    // stay in it.
-    uint32_t next_object_in_cell = kInvalidObjectIndex;
+public:
+    Field<Vec2f> position;
+    Field<Vec2f> old_position;
+    Field<float> radius;
+    Field<Vec4<uint8_t>> color;
+    Field<bool> movable;
 
-    Vec4<uint8_t> color{};
-    bool movable : 1 {};
+    // Anything that can write an object can be handed to something that only reads it.
+    operator BasicVerletObject<true>() const  // NOLINT
+        requires(!kIsConst)
+    {
+        return {
+            .position = position,
+            .old_position = old_position,
+            .radius = radius,
+            .color = color,
+            .movable = movable,
+        };
+    }
 
     [[nodiscard]] bool IsMovable() const { return movable; }
 
-    [[nodiscard]] static constexpr float GetRadius() { return 0.5f; }
-
-    // This property guarantees that there is at least one bit at the endof the object
-    // which can be used to mark object as dead or alive
-    uint8_t reserved_property_that_goes_last : 1 {};
+    [[nodiscard]] float GetRadius() const { return radius; }
 };
 
+using VerletObject = BasicVerletObject<false>;
+using ConstVerletObject = BasicVerletObject<true>;
+
 }  // namespace verlet
@@ -1,58 +1,269 @@
 #include "object_pool.hpp"
 
+#include <algorithm>
+
 namespace verlet
 {
-std::tuple<ObjectId, VerletObject&> ObjectPool::Alloc()
+bool ObjectPool::IsAlive(const ObjectId& id) const
+{
+    if (!id.IsValid()) return false;
+    if (!dense_) return IsSlotAlive(id.GetValue());
+
+    const size_t handle = id.GetValue() & kHandleMask;
+    return handle < handle_slots_.size() && handle_slots_[handle] != kInvalidObjectIndex &&
+           handle_generations_[handle] == id.GetValue() >> 32;
+}
+
+void ObjectPool::SetDenseEnabled(bool enabled)
+{
+    assert(SlotsCount() == 0);
+    dense_ = enabled;
+}
+
+void ObjectPool::SetHugePagesEnabled(bool enabled)
+{
+    huge_pages_ = enabled;
+    positions_.SetHugePagesEnabled(enabled);
+    old_positions_.SetHugePagesEnabled(enabled);
+    cell_links_.SetHugePagesEnabled(enabled);
+    flags_.SetHugePagesEnabled(enabled);
+    radii_.SetHugePagesEnabled(enabled);
+    colors_.SetHugePagesEnabled(enabled);
+    slot_handles_.SetHugePagesEnabled(enabled);
+}
+
+std::tuple<ObjectId, VerletObject> ObjectPool::Alloc()
+{
+    size_t index = 0;
+    if (!free_slots_.empty())
+    {
+        index = free_slots_.back();
+        free_slots_.pop_back();
+    }
+    else
+    {
+        index = SlotsCount();
+        Grow(1);
+    }
+
+    Occupy(index);
+    return {IdAt(index), ObjectAt(index)};
+}
+
+std::vector<std::tuple<ObjectId, VerletObject>> ObjectPool::AllocBatch(const size_t count)
+{
+    const size_t reused = std::min(count, free_slots_.size());
+    size_t new_slot = SlotsCount();
+    Grow(count - reused);
+
+    if (dense_)
+    {
+        const size_t new_handles = count - std::min(count, free_handles_.size());
+        handle_slots_.reserve(handle_slots_.size() + new_handles);
+        handle_generations_.reserve(handle_generations_.size() + new_handles);
+    }
+
+    std::vector<std::tuple<ObjectId, VerletObject>> objects;
+    objects.reserve(count);
+    for (size_t i = 0; i != count; ++i)
+    {
+        size_t index = 0;
+        if (i < reused)
+        {
+            index = free_slots_.back();
+            free_slots_.pop_back();
+        }
+        else
+        {
+            index = new_slot++;
+        }
+
+        Occupy(index);
+        objects.emplace_back(IdAt(index), ObjectAt(index));
+    }
+
+    return objects;
+}
+
+void ObjectPool::Grow(const size_t count)
+{
+    const size_t slots = SlotsCount() + count;
+    positions_.resize(slots);
+    old_positions_.resize(slots);
+    cell_links_.resize(slots);
+    flags_.resize(slots);
+    radii_.resize(slots);
+    colors_.resize(slots);
+    if (dense_) slot_handles_.resize(slots);
+    alive_bits_.resize((slots + 63) / 64);
+}
+
+void ObjectPool::Occupy(const size_t index)
 {
     ++count_;
-    if (first_free_.IsValid())
+    positions_[index] = {};
+    old_positions_[index] = {};
+    cell_links_[index] = kInvalidObjectIndex;
+    flags_[index] = {.alive = true};
+    alive_bits_[index / 64] |= uint64_t{1} << (index % 64);
+    radii_[index] = kDefaultObjectRadius;
+    colors_[index] = {};
+
+    if (!dense_) return;
+
+    uint32_t handle = 0;
+    if (!free_handles_.empty())
     {
-        auto id = first_free_;
-        assert(valid_ones_.insert(id).second);
-        auto& entry = GetSlot(id);
-        first_free_ = entry.AsFreeSlot().next_free_;
-        return {id, ConvertFreeSlotToObjectSlot(entry)};
+        handle = free_handles_.back();
+        free_handles_.pop_back();
     }
     else
     {
-        auto id = ObjectId::FromValue(entries_.size());
-        assert(valid_ones_.insert(id).second);
-        auto& entry = entries_.emplace_back();
-        return {id, ConstructObjectSlot(entry)};
+        handle = static_cast<uint32_t>(handle_slots_.size());
+        handle_slots_.emplace_back();
+        handle_generations_.emplace_back();
     }
+
+    handle_slots_[handle] = static_cast<uint32_t>(index);
+    slot_handles_[index] = handle;
 }
 
 void ObjectPool::Free(ObjectId id)
 {
-    assert(valid_ones_.erase(id) == 1);
-    assert(GetSlot(id).data_.back() != 0);
-    auto& free_slot = ConvertObjectSlotToFreeSlot(GetSlot(id));
-    free_slot.next_free_ = first_free_;
-    first_free_ = id;
+    assert(IsAlive(id));
+    const size_t index = IndexOf(id);
+    flags_[index] = {};
+    alive_bits_[index / 64] &= ~(uint64_t{1} << (index % 64));
+    free_slots_.push_back(static_cast<uint32_t>(index));
     --count_;
+
+    if (dense_)
+    {
+        const uint32_t handle = slot_handles_[index];
+        handle_slots_[handle] = kInvalidObjectIndex;
+        ++handle_generations_[handle];
+        free_handles_.push_back(handle);
+    }
 }
 
-void ObjectPool::Clear()
+void ObjectPool::SetSlotsAlive(const size_t count)
 {
-    for (auto& entry : entries_)
+    alive_bits_.assign((count + 63) / 64, ~uint64_t{0});
+    if (count % 64 != 0) alive_bits_.back() = (uint64_t{1} << (count % 64)) - 1;
+}
+
+void ObjectPool::MoveSlot(const size_t from, const size_t to)
+{
+    positions_[to] = positions_[from];
+    old_positions_[to] = old_positions_[from];
+    cell_links_[to] = cell_links_[from];
+    flags_[to] = flags_[from];
+    radii_[to] = radii_[from];
+    colors_[to] = colors_[from];
+    slot_handles_[to] = slot_handles_[from];
+    handle_slots_[slot_handles_[to]] = static_cast<uint32_t>(to);
+}
+
+std::vector<std::tuple<uint32_t, uint32_t>> ObjectPool::Compact()
+{
+    assert(dense_);
+
+    // The lowest holes are filled first, each with the last live object, which is a
+    // swap-remove of every freed object done in one go.
+    std::ranges::sort(free_slots_);
+    std::vector<std::tuple<uint32_t, uint32_t>> moves;
+    size_t end = SlotsCount();
+    for (const uint32_t hole : free_slots_)
     {
-        if (entry.data_.back() != 0)
+        while (end != 0 && !flags_[end - 1].alive) --end;
+        if (hole >= end) break;
+
+        --end;
+        MoveSlot(end, hole);
+        moves.emplace_back(static_cast<uint32_t>(end), hole);
+    }
+
+    assert(end == count_);
+    positions_.resize(count_);
+    old_positions_.resize(count_);
+    cell_links_.resize(count_);
+    flags_.resize(count_);
+    radii_.resize(count_);
+    colors_.resize(count_);
+    slot_handles_.resize(count_);
+    SetSlotsAlive(count_);
+    free_slots_.clear();
+
+    return moves;
+}
+
+ObjectIdRemap ObjectPool::Reorder(std::span<const ObjectId> order)
+{
+    assert(order.size() == count_);
+
+    ObjectIdRemap remap;
+    remap.keeps_ids = dense_;
+    if (!dense_)
+    {
+        remap.new_ids.resize(SlotsCount(), kInvalidObjectId);
+        for (const size_t new_index : std::views::iota(size_t{0}, order.size()))
+        {
+            assert(flags_[IndexOf(order[new_index])].alive);
+            remap.new_ids[IndexOf(order[new_index])] = ObjectId::FromValue(new_index);
+        }
+    }
+
+    // Gathered aside and copied back, so that the arrays stay where they are.
+    auto gather = [&]<typename T>(StableVector<T>& array)
+    {
+        std::vector<T> reordered;
+        reordered.reserve(order.size());
+        for (const ObjectId& id : order) reordered.push_back(array[IndexOf(id)]);
+        array.resize(order.size());
+        std::ranges::copy(reordered, array.begin());
+    };
+
+    gather(positions_);
+    gather(old_positions_);
+    gather(flags_);
+    gather(radii_);
+    gather(colors_);
+    if (dense_)
+    {
+        gather(slot_handles_);
+        for (const size_t index : std::views::iota(size_t{0}, order.size()))
         {
-            entry.AsObject().~VerletObject();
+            handle_slots_[slot_handles_[index]] = static_cast<uint32_t>(index);
         }
     }
 
+    // Links are the grid's business and mean nothing once the objects have moved.
+    cell_links_.assign(order.size(), kInvalidObjectIndex);
+    SetSlotsAlive(order.size());
+    free_slots_.clear();
+
+    return remap;
+}
+
+void ObjectPool::Clear()
+{
     // Freeing the slots one by one would leave them on the free list in reverse,
     // so the next objects would be allocated back to front. Emptying the pool
     // instead hands out the same identifiers a new pool would, in the same order,
     // which is what a simulation replayed from the start has to see.
-    entries_.clear();
-    first_free_ = kInvalidObjectId;
+    positions_.clear();
+    old_positions_.clear();
+    cell_links_.clear();
+    flags_.clear();
+    alive_bits_.clear();
+    radii_.clear();
+    colors_.clear();
+    free_slots_.clear();
+    slot_handles_.clear();
+    handle_slots_.clear();
+    handle_generations_.clear();
+    free_handles_.clear();
     count_ = 0;
-
-#ifndef NDEBUG
-    valid_ones_.clear();
-#endif
 }
 
 }  // namespace verlet
@@ -1,147 +1,350 @@
 #pragma once
 
 #include <edt/concepts/callable.hpp>
+#include <bit>
 #include <cassert>
+#include <cstdint>
+#include <limits>
+#include <optional>
 #include <ranges>
+#include <span>
 #include <vector>
 
-#ifndef NDEBUG
-#include "klvk/template/tagged_id_hash.hpp"
-#endif
-
 #include "object.hpp"
+#include "stable_vector.hpp"
 
 namespace verlet
 {
 
-struct FreePoolEntry
+// Where every object went when the pool was reordered. Indexed by the value an id had
+// before, holding the id the same object has now; ids that named no object map to nothing.
+class ObjectIdRemap
 {
-    ObjectId next_free_ = kInvalidObjectId;
+public:
+    [[nodiscard]] ObjectId operator()(const ObjectId& old_id) const
+    {
+        if (keeps_ids) return old_id;
+        if (!old_id.IsValid() || old_id.GetValue() >= new_ids.size()) return kInvalidObjectId;
+        return new_ids[old_id.GetValue()];
+    }
+
+    std::vector<ObjectId> new_ids;
+
+    // A dense pool names its objects by handles that follow them wherever they are stored, so
+    // its ids come out of a reorder as they went in.
+    bool keeps_ids = false;
 };
 
-struct ObjectPoolEntry
+// Objects are stored field by field: every field is an array of its own, indexed by the
+// slot of the object. The solver's passes move positions around and little else, so
+// they stream the arrays they need and never pull colors through the cache. A freed slot
+// keeps its place in every array and is handed out again by the next allocation. The arrays
+// grow in place rather than being copied somewhere larger, so an object handed out stays
+// where it is until it is freed, compacted or reordered, however many are spawned after.
+//
+// An id is the slot of its object, unless the pool is dense. A dense pool moves objects into
+// the slots freed before them, so that its objects stay packed at the front of the arrays,
+// and names them by handles instead: the low half of an id picks an entry of a table that
+// says where the object is now, and the high half is how many times that entry had been
+// freed when the id was handed out. An id kept past the death of its object names nothing,
+// rather than whatever object took the slot after.
+class ObjectPool
 {
-    static_assert(sizeof(FreePoolEntry) < sizeof(VerletObject));
-    static constexpr size_t kSlotSize = std::max(sizeof(FreePoolEntry), sizeof(VerletObject));
-    static constexpr size_t kSlotAlignment = std::max(alignof(FreePoolEntry), alignof(VerletObject));
+public:
+    // The slots whose bits are set in a bitmap of the live ones, lowest first. A word of the
+    // bitmap with no live slot is skipped whole, so a pool mostly freed is walked in about as
+    // many steps as it has objects.
+    class LiveSlotsView : public std::ranges::view_interface<LiveSlotsView>
+    {
+    public:
+        class Iterator
+        {
+        public:
+            using value_type = size_t;
+            using difference_type = std::ptrdiff_t;
+
+            Iterator() = default;
+            explicit Iterator(std::span<const uint64_t> words) : words_{words}
+            {
+                if (!words_.empty()) SkipEmptyWords(words_.front());
+            }
+
+            [[nodiscard]] size_t operator*() const
+            {
+                return word_index_ * 64 + static_cast<size_t>(std::countr_zero(word_));
+            }
+
+            Iterator& operator++()
+            {
+                SkipEmptyWords(word_ & (word_ - 1));
+                return *this;
+            }
+
+            void operator++(int) { ++*this; }
+
+            [[nodiscard]] bool operator==(std::default_sentinel_t) const { return word_index_ == words_.size(); }
+
+        private:
+            // Takes what is left of the current word and moves on to the next word with a bit
+            // set if nothing is.
+            void SkipEmptyWords(uint64_t word)
+            {
+                while (word == 0 && ++word_index_ != words_.size()) word = words_[word_index_];
+                word_ = word;
+            }
+
+        private:
+            std::span<const uint64_t> words_;
+            size_t word_index_ = 0;
+            uint64_t word_ = 0;
+        };
 
-    VerletObject& AsObject()
+        LiveSlotsView() = default;
+        explicit LiveSlotsView(std::span<const uint64_t> words) : words_{words} {}
+
+        [[nodiscard]] Iterator begin() const { return Iterator{words_}; }
+        [[nodiscard]] std::default_sentinel_t end() const { return {}; }  // NOLINT
+
+    private:
+        std::span<const uint64_t> words_;
+    };
+
+    [[nodiscard]] VerletObject Get(const ObjectId& id)
     {
-        return *reinterpret_cast<VerletObject*>(data_.data());  // NOLINT
+        assert(IsAlive(id));
+        return ObjectAt(IndexOf(id));
     }
 
-    [[nodiscard]] const VerletObject& AsObject() const
+    [[nodiscard]] ConstVerletObject Get(const ObjectId& id) const
     {
-        return *reinterpret_cast<const VerletObject*>(data_.data());  // NOLINT
+        assert(IsAlive(id));
+        return ObjectAt(IndexOf(id));
     }
 
-    FreePoolEntry& AsFreeSlot()
+    // For ids kept from an earlier frame, whose object may have been freed since: nothing
+    // rather than whatever object took the slot after, as far as IsAlive can tell.
+    [[nodiscard]] std::optional<VerletObject> TryGet(const ObjectId& id)
     {
-        return *reinterpret_cast<FreePoolEntry*>(data_.data());  // NOLINT
+        if (!IsAlive(id)) return std::nullopt;
+        return ObjectAt(IndexOf(id));
     }
 
-    alignas(kSlotAlignment) std::array<uint8_t, kSlotSize> data_;
-};
+    [[nodiscard]] std::optional<ConstVerletObject> TryGet(const ObjectId& id) const
+    {
+        if (!IsAlive(id)) return std::nullopt;
+        return ObjectAt(IndexOf(id));
+    }
 
-class ObjectPool
-{
-public:
-    [[nodiscard]] VerletObject& Get(const ObjectId& id)
+    // Only a dense pool tells an id whose slot has been handed out again from the id of the
+    // object there now.
+    [[nodiscard]] bool IsAlive(const ObjectId& id) const;
+
+    // The slot of the object an id names, and the id of the object in a slot.
+    [[nodiscard]] size_t IndexOf(const ObjectId& id) const
+    {
+        return dense_ ? handle_slots_[id.GetValue() & kHandleMask] : id.GetValue();
+    }
+
+    [[nodiscard]] ObjectId IdAt(const size_t index) const
+    {
+        if (!dense_) return ObjectId::FromValue(index);
+        const uint32_t handle = slot_handles_[index];
+        return MakeHandle(handle, handle_generations_[handle]);
+    }
+
+    [[nodiscard]] VerletObject ObjectAt(const size_t index)
     {
-        assert(valid_ones_.contains(id));
-        return GetSlot(id).AsObject();
+        assert(index < SlotsCount());
+        return {
+            .position = positions_[index],
+            .old_position = old_positions_[index],
+            .radius = radii_[index],
+            .color = colors_[index],
+            .movable = flags_[index].movable,
+        };
     }
 
-    [[nodiscard]] const VerletObject& Get(const ObjectId& id) const
+    [[nodiscard]] ConstVerletObject ObjectAt(const size_t index) const
     {
-        assert(valid_ones_.contains(id));
-        return GetSlot(id).AsObject();
+        assert(index < SlotsCount());
+        return {
+            .position = positions_[index],
+            .old_position = old_positions_[index],
+            .radius = radii_[index],
+            .color = colors_[index],
+            .movable = flags_[index].movable,
+        };
     }
 
+    // The slots of the live objects, in slot order.
+    [[nodiscard]] LiveSlotsView LiveSlots() const { return LiveSlotsView{alive_bits_}; }
+
     [[nodiscard]] auto Identifiers() const
     {
-        return std::views::iota(size_t{0}, entries_.size()) |
-               std::views::filter([&](const size_t index) -> bool { return entries_[index].data_.back(); }) |
-               std::views::transform([&](const size_t index) { return ObjectId::FromValue(index); });
+        return LiveSlots() | std::views::transform([&](const size_t index) { return IdAt(index); });
     }
 
     [[nodiscard]] auto IdentifiersAndObjects()
     {
-        return Identifiers() |
-               std::views::transform([&](ObjectId id) -> std::tuple<ObjectId, VerletObject&> { return {id, Get(id)}; });
+        return LiveSlots() |
+               std::views::transform(
+                   [&](const size_t index) -> std::tuple<ObjectId, VerletObject>
+                   { return {IdAt(index), ObjectAt(index)}; });
     }
 
     [[nodiscard]] auto IdentifiersAndObjects() const
     {
-        return Identifiers() |
+        return LiveSlots() |
                std::views::transform(
-                   [&](ObjectId id) -> std::tuple<ObjectId, const VerletObject&> { return {id, Get(id)}; });
+                   [&](const size_t index) -> std::tuple<ObjectId, ConstVerletObject>
+                   { return {IdAt(index), ObjectAt(index)}; });
     }
 
     [[nodiscard]] auto Objects()
     {
-        return Identifiers() | std::views::transform([&](ObjectId id) -> decltype(auto) { return Get(id); });
+        return LiveSlots() | std::views::transform([&](const size_t index) { return ObjectAt(index); });
     }
 
     [[nodiscard]] auto Objects() const
     {
-        return Identifiers() | std::views::transform([&](ObjectId id) -> decltype(auto) { return Get(id); });
+        return LiveSlots() | std::views::transform([&](const size_t index) { return ObjectAt(index); });
     }
 
-    std::tuple<ObjectId, VerletObject&> Alloc();
+    // The arrays themselves, one element per slot whether the slot is taken or not. Only
+    // the elements of live objects mean anything.
+    [[nodiscard]] std::span<Vec2f> Positions() { return positions_; }
+    [[nodiscard]] std::span<const Vec2f> Positions() const { return positions_; }
+    [[nodiscard]] std::span<Vec2f> OldPositions() { return old_positions_; }
+    [[nodiscard]] std::span<const Vec2f> OldPositions() const { return old_positions_; }
+    [[nodiscard]] std::span<const ObjectFlags> Flags() const { return flags_; }
+    [[nodiscard]] std::span<const float> Radii() const { return radii_; }
+
+    // The grid threads its cells through the objects: each object names the one its cell
+    // holds after it. Nothing else in the pool reads these, and freeing an object leaves its
+    // link alone, so a cell can still be walked past an object deleted on the way.
+    [[nodiscard]] std::span<uint32_t> CellLinks() { return cell_links_; }
+    [[nodiscard]] std::span<const uint32_t> CellLinks() const { return cell_links_; }
+
+    // Only an empty pool can change how it names its objects.
+    [[nodiscard]] bool IsDenseEnabled() const { return dense_; }
+    void SetDenseEnabled(bool enabled);
+
+    std::tuple<ObjectId, VerletObject> Alloc();
+
+    // The same objects count calls to Alloc would give, in the same order, but the arrays grow
+    // once for all of them.
+    std::vector<std::tuple<ObjectId, VerletObject>> AllocBatch(size_t count);
+
     void Free(ObjectId id);
+
+    // The slots freed and not handed out again, which are the holes a dense pool compacts.
+    [[nodiscard]] std::span<const uint32_t> FreeSlots() const { return free_slots_; }
+
+    // Dense pools only: moves the last objects into the free slots before them until the live
+    // objects take the first ObjectsCount() slots, and drops the slots after. Returns where
+    // every moved object was and where it is now, in the order they moved. Ids keep naming
+    // the same objects, but anything else that knows objects by slot has to follow the moves.
+    std::vector<std::tuple<uint32_t, uint32_t>> Compact();
+
+    // Moves the objects so that order[i] ends up in slot i. The order has to name every live
+    // object once; the pool is left without holes, and every id from before has to go
+    // through the returned remap to keep naming the same object.
+    ObjectIdRemap Reorder(std::span<const ObjectId> order);
+
     [[nodiscard]] size_t ObjectsCount() const { return count_; }
 
-    void Clear();
+    // How many slots the arrays hold, live or free, and the most they can. Every array sets
+    // aside address space for the most on first use, which costs no memory until it is used.
+    [[nodiscard]] size_t SlotsCount() const { return flags_.size(); }
+    static constexpr size_t kMaxSlots = size_t{1} << 28;
 
-private:
-    [[nodiscard]] ObjectPoolEntry& GetSlot(const ObjectId& object_id)
-    {
-        assert(object_id.GetValue() < entries_.size());
-        return entries_[object_id.GetValue()];
-    }
+    // Whether the arrays ask to be backed by transparent huge pages, which take far fewer TLB
+    // entries to cover arrays of millions of objects than ordinary pages do. It is advice, and
+    // a system without huge pages goes on with ordinary ones.
+    [[nodiscard]] bool IsHugePagesEnabled() const { return huge_pages_; }
+    void SetHugePagesEnabled(bool enabled);
 
-    [[nodiscard]] const ObjectPoolEntry& GetSlot(const ObjectId& object_id) const
+    // What a slot takes in the arrays a substep reads, and in all of them, the handles of a
+    // dense pool included and the bit of the slot in the bitmap of live ones left out. No pass
+    // reads every one of the former: the integration walks the cell links to positions, old
+    // positions and flags, and the collisions read radii where it reads old positions.
+    [[nodiscard]] static constexpr size_t SubStepBytesPerSlot()
     {
-        assert(object_id.GetValue() < entries_.size());
-        return entries_[object_id.GetValue()];
+        return kElementBytes<
+            decltype(positions_),
+            decltype(old_positions_),
+            decltype(cell_links_),
+            decltype(flags_),
+            decltype(radii_)>;
     }
-
-    VerletObject& ConstructObjectSlot(ObjectPoolEntry& entry)
+    [[nodiscard]] size_t BytesPerSlot() const
     {
-        auto& object = entry.AsObject();
-        new (&object) VerletObject();
-        entry.data_.back() |= 0b1000000;
-        return object;
+        return SubStepBytesPerSlot() + kElementBytes<decltype(colors_)> +
+               (dense_ ? kElementBytes<decltype(slot_handles_)> : 0);
     }
 
-    FreePoolEntry& ConstructFreeSlot(ObjectPoolEntry& entry)
-    {
-        auto& free_slot = entry.AsFreeSlot();
-        new (&free_slot) FreePoolEntry();
-        entry.data_.back() = false;
-        return free_slot;
-    }
+    void Clear();
+
+private:
+    static constexpr size_t kHandleMask = std::numeric_limits<uint32_t>::max();
+
+    // What one element of each of the arrays takes together.
+    template <typename... Arrays>
+    static constexpr size_t kElementBytes = (sizeof(typename Arrays::value_type) + ...);
 
-    FreePoolEntry& ConvertObjectSlotToFreeSlot(ObjectPoolEntry& entry)
+    [[nodiscard]] static ObjectId MakeHandle(const uint32_t handle, const uint32_t generation)
     {
-        entry.AsObject().~VerletObject();
-        return ConstructFreeSlot(entry);
+        return ObjectId::FromValue(size_t{generation} << 32 | handle);
     }
 
-    VerletObject& ConvertFreeSlotToObjectSlot(ObjectPoolEntry& entry)
+    [[nodiscard]] bool IsSlotAlive(const size_t index) const
     {
-        entry.AsFreeSlot().~FreePoolEntry();
-        return ConstructObjectSlot(entry);
+        return index < SlotsCount() && (alive_bits_[index / 64] >> (index % 64) & 1) != 0;
     }
 
+    // Appends count free slots to every array.
+    void Grow(size_t count);
+
+    // Turns a free slot into a new object with default fields.
+    void Occupy(size_t index);
+
+    // Marks the first count slots live and the others free, for a pool left without holes.
+    void SetSlotsAlive(size_t count);
+
+    // Copies every field of the object in one slot over the one in another.
+    void MoveSlot(size_t from, size_t to);
+
 private:
     size_t count_ = 0;
-    std::vector<ObjectPoolEntry> entries_;
-    ObjectId first_free_ = kInvalidObjectId;
+    bool dense_ = false;
+    bool huge_pages_ = false;
+
+    // Hot: read or written by every substep.
+    StableVector<Vec2f> positions_{kMaxSlots};
+    StableVector<Vec2f> old_positions_{kMaxSlots};
+    StableVector<uint32_t> cell_links_{kMaxSlots};
+    StableVector<ObjectFlags> flags_{kMaxSlots};
+
+    // Whether each slot is taken, a bit per slot, the lowest bit of a word first. It says no
+    // more than the flags do, but is what walks over the live objects and checks ids read.
+    std::vector<uint64_t> alive_bits_;
+
+    // Read by every collision, but only ever written by whoever spawns an object, so kept out
+    // of the arrays the integration streams through.
+    StableVector<float> radii_{kMaxSlots};
+
+    // Cold: only the renderer and the tools look at these.
+    StableVector<Vec4<uint8_t>> colors_{kMaxSlots};
+
+    // Freed slots, the most recently freed last, which is the one the next allocation takes.
+    std::vector<uint32_t> free_slots_;
 
-#ifndef NDEBUG
-    ankerl::unordered_dense::set<ObjectId, klvk::TaggedIdentifierHash<ObjectId>> valid_ones_;
-#endif
+    // Dense pools only. The handle of the object in every slot, and for every handle the slot
+    // of its object, or kInvalidObjectIndex once freed, and how many times it was freed.
+    // Freed handles are handed out again like freed slots.
+    StableVector<uint32_t> slot_handles_{kMaxSlots};
+    std::vector<uint32_t> handle_slots_;
+    std::vector<uint32_t> handle_generations_;
+    std::vector<uint32_t> free_handles_;
 };
 }  // namespace verlet
@@ -0,0 +1,325 @@
+#include "collision_kernels.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <ranges>
+
+#include "klvk/error_handling.hpp"
+#include "magic_enum/magic_enum.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define VERLET_COLLISION_KERNELS_X86_64
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC accepts AVX2 intrinsics anywhere; GCC and Clang only in functions built for AVX2.
+#if defined(__GNUC__)
+#define VERLET_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define VERLET_TARGET_AVX2
+#endif
+
+namespace verlet
+{
+namespace
+{
+constexpr float kEpsilon = 0.0001f;
+
+// Measures one pair that touches at min_distance, the sum of the two radii, and, if the two
+// overlap, sets how far apart they have to be pushed. Returns whether they overlap.
+[[nodiscard]] bool PairCorrection(
+    const Vec2f& position,
+    const Vec2f& another_position,
+    const float min_distance,
+    Vec2f& col_vec)
+{
+    const Vec2f axis = position - another_position;
+    const float dist_sq = axis.SquaredLength();
+    if (dist_sq < min_distance * min_distance && dist_sq > kEpsilon)
+    {
+        const float dist = std::sqrt(dist_sq);
+        const float delta = 0.5f * min_distance - dist / 2;
+        col_vec = axis * (delta / dist);
+        return true;
+    }
+
+    return false;
+}
+
+void ApplyCorrection(CollisionNeighbours& neighbours, size_t a, size_t b, const Vec2f& col_vec)
+{
+    const std::span x = neighbours.X();
+    const std::span y = neighbours.Y();
+    const std::span radii = neighbours.Radii();
+    const std::span flags = neighbours.Flags();
+    const auto [ac, bc] = CollisionKernels::MassCoefficients(flags[a], radii[a], flags[b], radii[b]);
+    Vec2f position{x[a], y[a]};
+    Vec2f another_position{x[b], y[b]};
+    position += ac * col_vec;
+    another_position -= bc * col_vec;
+    x[a] = position.x();
+    y[a] = position.y();
+    x[b] = another_position.x();
+    y[b] = another_position.y();
+}
+
+// Where the neighbours an object is solved against start.
+[[nodiscard]] size_t FirstOther(const size_t object, const CollisionStencil stencil)
+{
+    return stencil == CollisionStencil::Half ? object + 1 : 0;
+}
+
+void SolveScalar(CollisionNeighbours& neighbours, size_t first, size_t count, CollisionStencil stencil)
+{
+    const std::span x = neighbours.X();
+    const std::span y = neighbours.Y();
+    const std::span radii = neighbours.Radii();
+    for (const size_t object : std::views::iota(first, first + count))
+    {
+        for (const size_t another_object : std::views::iota(FirstOther(object, stencil), neighbours.Size()))
+        {
+            if (object == another_object) continue;
+
+            Vec2f col_vec;
+            const Vec2f position{x[object], y[object]};
+            const Vec2f another_position{x[another_object], y[another_object]};
+            if (PairCorrection(position, another_position, radii[object] + radii[another_object], col_vec))
+            {
+                ApplyCorrection(neighbours, object, another_object, col_vec);
+            }
+        }
+    }
+}
+
+#ifdef VERLET_COLLISION_KERNELS_X86_64
+[[nodiscard]] bool CpuSupportsAvx2()
+{
+#if defined(_MSC_VER)
+    int info[4]{};
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+
+    // The CPU has to have AVX and the OS has to save the AVX registers on a context switch.
+    __cpuid(info, 1);
+    constexpr int kOsxsave = 1 << 27;
+    constexpr int kAvx = 1 << 28;
+    if ((info[2] & kOsxsave) == 0 || (info[2] & kAvx) == 0) return false;
+    if ((_xgetbv(0) & 0b110) != 0b110) return false;
+
+    __cpuidex(info, 7, 0);
+    constexpr int kAvx2 = 1 << 5;
+    return (info[1] & kAvx2) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+// Eight pairs are measured at once, with the same operations in the same order as the scalar
+// kernel, so every lane gets the exact float the scalar kernel would from the same positions.
+// Most pairs of a neighbourhood are too far apart to matter and are dropped eight at a time;
+// the few close ones are then corrected one at a time, in order, so both kernels end up with
+// the same positions to the bit.
+VERLET_TARGET_AVX2 void SolveAvx2(CollisionNeighbours& neighbours, size_t first, size_t count, CollisionStencil stencil)
+{
+    constexpr size_t kLanes = 8;
+    const std::span x = neighbours.X();
+    const std::span y = neighbours.Y();
+    const std::span radii = neighbours.Radii();
+    const std::span flags = neighbours.Flags();
+    const size_t neighbours_count = neighbours.Size();
+
+    const __m256i lane_indices = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256 epsilon = _mm256_set1_ps(kEpsilon);
+    const __m256 half = _mm256_set1_ps(0.5f);
+
+    // Pairs further apart than the reach can be skipped even after the object has moved a bit.
+    // The reach is the distance a pair touches at and a bit more, which leaves a margin over
+    // kMaxMoveWithinReach for the rounding of stale distances.
+    constexpr float kReachOverMinDistance = 0.25f;
+    constexpr float kMaxMoveWithinReach = 0.2f;
+    const __m256 reach_over_min_distance = _mm256_set1_ps(kReachOverMinDistance);
+
+    alignas(32) float correction_x[kLanes];
+    alignas(32) float correction_y[kLanes];
+
+    for (const size_t object : std::views::iota(first, first + count))
+    {
+        size_t batch = FirstOther(object, stencil);
+        while (batch < neighbours_count)
+        {
+            // The last batch may be short; lanes past the end load nothing and touch nothing.
+            const auto lanes_left = static_cast<int>(std::min(kLanes, neighbours_count - batch));
+            const __m256i in_range = _mm256_cmpgt_epi32(_mm256_set1_epi32(lanes_left), lane_indices);
+            const __m256 other_x = _mm256_maskload_ps(x.data() + batch, in_range);
+            const __m256 other_y = _mm256_maskload_ps(y.data() + batch, in_range);
+            const __m256 other_radius = _mm256_maskload_ps(radii.data() + batch, in_range);
+            const __m256 min_distance = _mm256_add_ps(_mm256_set1_ps(radii[object]), other_radius);
+            const __m256 min_distance_squared = _mm256_mul_ps(min_distance, min_distance);
+            const __m256 reach = _mm256_add_ps(min_distance, reach_over_min_distance);
+            const __m256 reach_squared = _mm256_mul_ps(reach, reach);
+
+            const __m256 axis_x = _mm256_sub_ps(_mm256_set1_ps(x[object]), other_x);
+            const __m256 axis_y = _mm256_sub_ps(_mm256_set1_ps(y[object]), other_y);
+            const __m256 dist_sq = _mm256_add_ps(_mm256_mul_ps(axis_x, axis_x), _mm256_mul_ps(axis_y, axis_y));
+
+            // The object itself is never further than epsilon from itself.
+            const __m256 touching = _mm256_and_ps(
+                _mm256_and_ps(
+                    _mm256_cmp_ps(dist_sq, min_distance_squared, _CMP_LT_OQ),
+                    _mm256_cmp_ps(dist_sq, epsilon, _CMP_GT_OQ)),
+                _mm256_castsi256_ps(in_range));
+            const __m256 in_reach =
+                _mm256_and_ps(_mm256_cmp_ps(dist_sq, reach_squared, _CMP_LT_OQ), _mm256_castsi256_ps(in_range));
+
+            auto reachable_lanes = static_cast<unsigned>(_mm256_movemask_ps(in_reach));
+            if (reachable_lanes == 0)
+            {
+                batch += kLanes;
+                continue;
+            }
+
+            const auto touching_lanes = static_cast<unsigned>(_mm256_movemask_ps(touching));
+            const __m256 dist = _mm256_sqrt_ps(dist_sq);
+            const __m256 delta = _mm256_sub_ps(_mm256_mul_ps(half, min_distance), _mm256_mul_ps(dist, half));
+            const __m256 scale = _mm256_div_ps(delta, dist);
+            _mm256_store_ps(correction_x, _mm256_mul_ps(axis_x, scale));
+            _mm256_store_ps(correction_y, _mm256_mul_ps(axis_y, scale));
+
+            // Until the object moves, the lanes hold what the scalar kernel would compute. Once
+            // it has, the pairs it can now reach are measured again the scalar way, and the
+            // pairs that were out of reach stay out of contact as long as it has moved by less
+            // than the reach leaves to spare. If it moves further than that, measuring starts
+            // over after the pair that moved it. This is PairCorrection and ApplyCorrection
+            // written out, so that it is built for AVX2 too: calling code built without it
+            // while the upper halves of the registers are in use costs more than the batch.
+            float moved_by = 0.f;
+            size_t next_batch = batch + kLanes;
+            for (; reachable_lanes != 0; reachable_lanes &= reachable_lanes - 1)
+            {
+                const auto lane = static_cast<size_t>(std::countr_zero(reachable_lanes));
+                const size_t another_object = batch + lane;
+                Vec2f col_vec{correction_x[lane], correction_y[lane]};
+                if (moved_by == 0.f)
+                {
+                    if ((touching_lanes & (1u << lane)) == 0) continue;
+                }
+                else
+                {
+                    const Vec2f axis{x[object] - x[another_object], y[object] - y[another_object]};
+                    const float pair_dist_sq = axis.SquaredLength();
+                    const float pair_min_distance = radii[object] + radii[another_object];
+                    if (!(pair_dist_sq < pair_min_distance * pair_min_distance && pair_dist_sq > kEpsilon)) continue;
+                    const float pair_dist = std::sqrt(pair_dist_sq);
+                    col_vec = axis * ((0.5f * pair_min_distance - pair_dist / 2) / pair_dist);
+                }
+
+                const auto [ac, bc] = CollisionKernels::MassCoefficients(
+                    flags[object],
+                    radii[object],
+                    flags[another_object],
+                    radii[another_object]);
+                x[object] += ac * col_vec.x();
+                y[object] += ac * col_vec.y();
+                x[another_object] -= bc * col_vec.x();
+                y[another_object] -= bc * col_vec.y();
+
+                moved_by += ac * (std::abs(col_vec.x()) + std::abs(col_vec.y()));
+                if (moved_by > kMaxMoveWithinReach)
+                {
+                    next_batch = another_object + 1;
+                    break;
+                }
+            }
+
+            batch = next_batch;
+        }
+    }
+}
+#endif
+}  // namespace
+
+bool CollisionKernels::IsSupported(CollisionKernel kernel)
+{
+    switch (kernel)
+    {
+    case CollisionKernel::Scalar:
+        return true;
+    case CollisionKernel::Avx2:
+#ifdef VERLET_COLLISION_KERNELS_X86_64
+    {
+        static const bool supported = CpuSupportsAvx2();
+        return supported;
+    }
+#else
+        return false;
+#endif
+    }
+
+    return false;
+}
+
+CollisionKernel CollisionKernels::Preferred()
+{
+    return CollisionKernel::Scalar;
+}
+
+CollisionKernels::Function CollisionKernels::Get(CollisionKernel kernel)
+{
+    klvk::ErrorHandling::Ensure(
+        IsSupported(kernel),
+        "Collision kernel {} is not supported here",
+        magic_enum::enum_name(kernel));
+
+    switch (kernel)
+    {
+    case CollisionKernel::Scalar:
+        return &SolveScalar;
+    case CollisionKernel::Avx2:
+#ifdef VERLET_COLLISION_KERNELS_X86_64
+        return &SolveAvx2;
+#else
+        break;
+#endif
+    }
+
+    return &SolveScalar;
+}
+
+void CollisionKernels::AccumulateCorrections(
+    const CollisionNeighbours& neighbours,
+    size_t first,
+    size_t count,
+    std::span<Vec2f> displacements)
+{
+    const std::span x = neighbours.X();
+    const std::span y = neighbours.Y();
+    const std::span radii = neighbours.Radii();
+    const std::span flags = neighbours.Flags();
+    const std::span indices = neighbours.Indices();
+    for (const size_t object : std::views::iota(first, first + count))
+    {
+        const Vec2f position{x[object], y[object]};
+        Vec2f displacement{};
+        for (const size_t another_object : std::views::iota(size_t{0}, neighbours.Size()))
+        {
+            if (object == another_object) continue;
+
+            Vec2f col_vec;
+            const Vec2f another_position{x[another_object], y[another_object]};
+            if (PairCorrection(position, another_position, radii[object] + radii[another_object], col_vec))
+            {
+                const float ac = std::get<0>(
+                    MassCoefficients(flags[object], radii[object], flags[another_object], radii[another_object]));
+                displacement += ac * col_vec;
+            }
+        }
+
+        displacements[indices[object]] += displacement;
+    }
+}
+
+}  // namespace verlet
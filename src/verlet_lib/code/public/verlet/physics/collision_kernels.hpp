@@ -0,0 +1,162 @@
+#pragma once
+
+#include <span>
+#include <tuple>
+#include <vector>
+
+#include "klvk/integral_aliases.hpp"
+#include "verlet/object.hpp"
+
+namespace verlet
+{
+
+// The code that pushes apart the objects of a cell and the objects around them they overlap.
+enum class CollisionKernel : u8
+{
+    // One pair at a time.
+    Scalar,
+
+    // Measures eight pairs at a time and lands on exactly the positions the scalar kernel
+    // does. That holds because the build keeps the compiler from fusing multiplies and adds
+    // in the scalar one.
+    Avx2,
+};
+
+// Which of the cells around a cell its objects are solved against.
+enum class CollisionStencil : u8
+{
+    // All nine, itself included, so every pair of touching objects is solved twice: once from
+    // each side.
+    Full,
+
+    // The cell itself, each object only against the objects after it, and the four cells
+    // ahead of it: right, above and the two on the right diagonals. Every pair is solved once,
+    // so a contact is pushed apart half as hard per substep, and a cell only reaches into the
+    // column to its right.
+    Half,
+};
+
+// How the corrections of one collision pass are put together.
+enum class CollisionIteration : u8
+{
+    // Gauss-Seidel: every pair is measured where the pairs solved before it left its objects,
+    // so tiles that share cells must not be solved at once and go color after color.
+    GaussSeidel,
+
+    // Jacobi: every object sums what its overlaps ask of it, all measured where the objects
+    // were when the pass began, and the sums are applied at once afterwards, scaled by a
+    // relaxation factor. Nothing moves while the pass measures, so every tile can be solved at
+    // once. A pass closes less of each overlap than a Gauss-Seidel one does.
+    Jacobi,
+};
+
+// The objects of a cell and of the cells around it, copied out of the pool coordinate by
+// coordinate so that a kernel can load a row of them at once, radii alongside. Their flags are
+// copied too, as the solver may list an object as fixed that is not. The objects of the cell itself
+// are a run of the list; a kernel solves each of them against the list, as much of it as the
+// stencil asks for, and moves the copies, which are then written back.
+class CollisionNeighbours
+{
+public:
+    void Clear()
+    {
+        indices_.clear();
+        x_.clear();
+        y_.clear();
+        radii_.clear();
+        flags_.clear();
+    }
+
+    void Add(uint32_t index, const Vec2f& position, float radius, const ObjectFlags& flags)
+    {
+        indices_.push_back(index);
+        x_.push_back(position.x());
+        y_.push_back(position.y());
+        radii_.push_back(radius);
+        flags_.push_back(flags);
+    }
+
+    // Lists count objects from first as fixed, whatever they are in the pool.
+    void Fix(size_t first, size_t count)
+    {
+        for (ObjectFlags& flags : std::span{flags_}.subspan(first, count)) flags.movable = false;
+    }
+
+    void WriteBack(std::span<Vec2f> positions) const
+    {
+        for (size_t i = 0; i != indices_.size(); ++i) positions[indices_[i]] = Vec2f{x_[i], y_[i]};
+    }
+
+    [[nodiscard]] size_t Size() const { return indices_.size(); }
+    [[nodiscard]] std::span<const uint32_t> Indices() const { return indices_; }
+    [[nodiscard]] std::span<float> X() { return x_; }
+    [[nodiscard]] std::span<float> Y() { return y_; }
+    [[nodiscard]] std::span<const float> X() const { return x_; }
+    [[nodiscard]] std::span<const float> Y() const { return y_; }
+    [[nodiscard]] std::span<const float> Radii() const { return radii_; }
+    [[nodiscard]] std::span<const ObjectFlags> Flags() const { return flags_; }
+
+private:
+    std::vector<uint32_t> indices_;
+    std::vector<float> x_;
+    std::vector<float> y_;
+    std::vector<float> radii_;
+    std::vector<ObjectFlags> flags_;
+};
+
+class CollisionKernels
+{
+public:
+    // Solves the neighbours from first to first + count, one after the other, each against
+    // the neighbours in the order they were added: every one of them for the full stencil,
+    // only the ones after it for the half stencil.
+    using Function = void (*)(CollisionNeighbours& neighbours, size_t first, size_t count, CollisionStencil stencil);
+
+    // How much of a correction each of the two objects takes: a fixed object takes none of it,
+    // and of two movable ones the bigger takes the smaller share, as much as the other is big.
+    [[nodiscard]] static constexpr std::tuple<float, float> MassCoefficients(
+        const ObjectFlags& a,
+        float radius_a,
+        const ObjectFlags& b,
+        float radius_b)
+    {
+        if (a.movable)
+        {
+            if (b.movable)
+            {
+                const float min_distance = radius_a + radius_b;
+                return {radius_b / min_distance, radius_a / min_distance};
+            }
+            else
+            {
+                return {1.f, 0.f};
+            }
+        }
+        else if (b.movable)
+        {
+            return {0.f, 1.f};
+        }
+
+        return {0.f, 0.f};
+    }
+
+    // Whether this build and the CPU it runs on can run the kernel.
+    [[nodiscard]] static bool IsSupported(CollisionKernel kernel);
+
+    // What a solver starts out with. That is the scalar kernel, because AVX2 came out slower on
+    // the bench scene; wider kernels are there to opt into where they measure faster.
+    [[nodiscard]] static CollisionKernel Preferred();
+
+    [[nodiscard]] static Function Get(CollisionKernel kernel);
+
+    // What a Jacobi pass runs in place of a kernel, whichever one is set: measures the
+    // neighbours from first to first + count against all the others and adds what each of them
+    // is asked to move to its entry of displacements, by pool index, moving nothing.
+    static void AccumulateCorrections(
+        const CollisionNeighbours& neighbours,
+        size_t first,
+        size_t count,
+        std::span<Vec2f> displacements);
+};
+
+}  // namespace verlet
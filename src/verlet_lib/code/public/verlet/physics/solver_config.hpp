@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+
+#include "edt/math/matrix.hpp"
+#include "klvk/integral_aliases.hpp"
+
+namespace verlet
+{
+
+// How a link holds its two objects at its distance.
+enum class LinkModel : u8
+{
+    // Every solve moves the objects all the way to the distance. A chain only stiffens over
+    // many solves, as a correction takes one solve to pass from one link to the next.
+    Positional,
+
+    // Extended position based dynamics: a link gives by its compliance, and what it has
+    // pushed within a substep counts against what it pushes on the next iteration, so
+    // iterating converges on the link's stiffness rather than on whatever the substeps allow.
+    // Without compliance, one iteration solves what Positional does.
+    Xpbd,
+};
+
+// What the solver simulates, as opposed to how it goes about it: every value here changes
+// where the objects end up, while the broadphase, kernel and thread count never do.
+struct SolverConfig
+{
+    // A frame is what one update advances the world by, split into this many substeps. Each
+    // substep rebuilds the grid and solves every collision once, so more of them hold stacks
+    // firmer at the cost of proportionally more work.
+    float time_step_seconds = 1.f / 60.f;
+    size_t substeps = 8;
+
+    // With adaptive substeps, substeps is only where the count starts. After every frame the
+    // solver picks the count for the next one so that the fastest object moves no further in
+    // a substep than max_substep_move of the radius a cell holds, going by how far it moved in
+    // this one. A calm scene then runs min_substeps, and a burst as many as it takes, up to
+    // max_substeps. Counts are rounded up to a power of two, for which the hot loops are built.
+    bool adaptive_substeps = false;
+    size_t min_substeps = 1;
+    size_t max_substeps = 16;
+    float max_substep_move = 0.25f;
+
+    // Links are solved link_iterations times every substep. link_compliance is what a link
+    // gives per unit of force when it is made without its own, in world units; zero is rigid.
+    // It only matters to LinkModel::Xpbd.
+    LinkModel link_model = LinkModel::Positional;
+    size_t link_iterations = 1;
+    float link_compliance = 0.f;
+
+    float velocity_damping = 40.f;  // arbitrary, approximating air friction
+    edt::Vec2f gravity{0.0f, -20.f};
+
+    // The width of a cell of the grid, which holds objects up to half of it. Smaller cells
+    // put fewer objects in each, but an object bigger than a cell is solved in a coarse level
+    // one at a time, so the cell should fit the objects most of the world is made of.
+    float cell_size = 1.f;
+};
+
+}  // namespace verlet
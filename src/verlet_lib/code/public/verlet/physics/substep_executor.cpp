@@ -0,0 +1,115 @@
+#include "substep_executor.hpp"
+
+#include <exception>
+
+#include "verlet/threading/cpu_relax.hpp"
+#include "verlet/threading/task_scheduler.hpp"
+
+namespace verlet
+{
+
+namespace
+{
+
+// About as long as a small batch takes, after which a thread waiting for a serial part of the
+// update to finish had better let go of its core.
+constexpr size_t kSpinsBeforeSleeping = size_t{1} << 14;
+
+// Returns once value is no longer old, and how long that took.
+[[nodiscard]] std::chrono::nanoseconds WaitForChange(const std::atomic<uint32_t>& value, const uint32_t old)
+{
+    if (value.load(std::memory_order_acquire) != old) return {};
+
+    const auto start = std::chrono::steady_clock::now();
+    size_t spins = 0;
+    while (value.load(std::memory_order_acquire) == old)
+    {
+        if (spins == kSpinsBeforeSleeping)
+        {
+            value.wait(old, std::memory_order_acquire);
+        }
+        else
+        {
+            ++spins;
+            CpuRelax();
+        }
+    }
+
+    return std::chrono::steady_clock::now() - start;
+}
+
+}  // namespace
+
+void SubStepExecutor::RunFrame(TaskScheduler& scheduler, const std::function<void()>& update)
+{
+    threads_count_ = scheduler.GetThreadsCount();
+    thread_waits_.assign(threads_count_, {});
+    phase_.store(0, std::memory_order_relaxed);
+
+    std::exception_ptr error;
+    scheduler.RunOnEveryThread(
+        [&](const size_t thread_index, const size_t)
+        {
+            if (thread_index != 0)
+            {
+                Work(thread_index);
+                return;
+            }
+
+            running_ = true;
+            try
+            {
+                update();
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            running_ = false;
+
+            // An empty job lets the others go.
+            job_ = {};
+            phase_.fetch_add(1, std::memory_order_release);
+            phase_.notify_all();
+        });
+
+    if (error) std::rethrow_exception(error);
+}
+
+void SubStepExecutor::RunJob(const Job& job)
+{
+    job_ = job;
+    pending_.store(static_cast<uint32_t>(threads_count_ - 1), std::memory_order_relaxed);
+    phase_.fetch_add(1, std::memory_order_release);
+    phase_.notify_all();
+
+    job.invoke(job.context, 0, threads_count_);
+
+    for (uint32_t pending = pending_.load(std::memory_order_acquire); pending != 0;
+         pending = pending_.load(std::memory_order_acquire))
+    {
+        thread_waits_[0] += WaitForChange(pending_, pending);
+    }
+}
+
+void SubStepExecutor::Work(const size_t thread_index)
+{
+    // Summed apart from thread_waits_, which shares its lines with the other threads' sums.
+    std::chrono::nanoseconds waited{};
+    uint32_t phase = 0;
+    while (true)
+    {
+        waited += WaitForChange(phase_, phase);
+        phase = phase_.load(std::memory_order_acquire);
+
+        const Job job = job_;
+        if (!job.invoke) break;
+
+        job.invoke(job.context, thread_index, threads_count_);
+        if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) pending_.notify_one();
+    }
+
+    thread_waits_[thread_index] = waited;
+}
+
+}  // namespace verlet
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+namespace verlet
+{
+
+class TaskScheduler;
+
+// Runs a whole update on every thread of the pool at once. The calling thread runs the update
+// and every other one waits for it to hand out work: a batch the update runs is published by
+// bumping a phase the others spin on, and ends once they have all counted down a barrier,
+// rather than going through the pool's queues and joining anew. Between two batches the
+// others keep spinning through the serial parts of the update; a wait that outlasts the spin
+// sleeps on the atomic instead.
+class SubStepExecutor
+{
+public:
+    // Calls update on the calling thread, with RunBatch handing work to every thread of the
+    // pool until update returns. An exception thrown by update is rethrown here once the
+    // other threads have left.
+    void RunFrame(TaskScheduler& scheduler, const std::function<void()>& update);
+
+    // Calls fn(thread_index, threads_count) on every thread of the frame and returns once all
+    // of them are done. Only the thread running the frame's update may call it.
+    template <typename Fn>
+    void RunBatch(Fn&& fn)
+    {
+        RunJob(
+            {.context = &fn,
+             .invoke = [](void* context, size_t thread_index, size_t threads_count)
+             { (*static_cast<std::remove_reference_t<Fn>*>(context))(thread_index, threads_count); }});
+    }
+
+    [[nodiscard]] bool IsRunning() const { return running_; }
+
+    // How long each thread of the last frame spent waiting: on the others at the end of a
+    // batch for the first thread, and for the next batch for all the others.
+    [[nodiscard]] std::span<const std::chrono::nanoseconds> GetThreadWaits() const { return thread_waits_; }
+
+private:
+    struct Job
+    {
+        void* context = nullptr;
+        void (*invoke)(void* context, size_t thread_index, size_t threads_count) = nullptr;
+    };
+
+    void RunJob(const Job& job);
+
+    // The loop of every thread but the first, until a job without a function comes.
+    void Work(size_t thread_index);
+
+private:
+    // Written by the first thread before it bumps the phase, and not again before all the
+    // others are done with it.
+    Job job_;
+    size_t threads_count_ = 1;
+    bool running_ = false;
+
+    // Kept apart so that the threads spinning on the phase do not share a line with the ones
+    // counting down.
+    alignas(64) std::atomic<uint32_t> phase_ = 0;
+    alignas(64) std::atomic<uint32_t> pending_ = 0;
+
+    std::vector<std::chrono::nanoseconds> thread_waits_;
+};
+
+}  // namespace verlet
@@ -1,10 +1,19 @@
 #include "verlet_solver.hpp"
 
+#include <bit>
+#include <cmath>
+#include <numeric>
+#include <optional>
+#include <tuple>
+#include <utility>
+
 #include "edt/functional/on_scope_leave.hpp"
 #include "edt/math/math.hpp"
-#include "edt/threading/batch_thread_pool.hpp"
 #include "fmt/ranges.h"  // IWYU pragma: keep
 #include "klvk/error_handling.hpp"
+#include "magic_enum/magic_enum.hpp"
+#include "verlet/threading/numa.hpp"
+#include "verlet/threading/task_scheduler.hpp"
 
 namespace verlet
 {
@@ -32,6 +41,60 @@ static_assert(ChunkBegin(8, 3, 1) == 3);
 static_assert(ChunkBegin(8, 3, 2) == 6);
 static_assert(ChunkBegin(8, 3, 2) + ChunkSize(8, 3, 2) == 8);
 static_assert(ChunkBegin(2, 8, 5) == 2);
+
+// The chunk an element falls in.
+constexpr size_t ChunkIndex(size_t total_amount, size_t num_chunks, size_t element_index)
+{
+    const size_t small_chunk = total_amount / num_chunks;
+    const size_t big_chunks_end = (small_chunk + 1) * (total_amount % num_chunks);
+    if (element_index < big_chunks_end) return element_index / (small_chunk + 1);
+    return total_amount % num_chunks + (element_index - big_chunks_end) / small_chunk;
+}
+
+static_assert(ChunkIndex(8, 3, 2) == 0);
+static_assert(ChunkIndex(8, 3, 3) == 1);
+static_assert(ChunkIndex(8, 3, 6) == 2);
+static_assert(ChunkIndex(8, 3, 7) == 2);
+static_assert(ChunkIndex(2, 8, 1) == 1);
+
+// Spreads the low 32 bits of a value over the even bits of the result.
+constexpr uint64_t SpreadBits(uint64_t value)
+{
+    value &= 0x00000000FFFFFFFF;
+    value = (value | (value << 16)) & 0x0000FFFF0000FFFF;
+    value = (value | (value << 8)) & 0x00FF00FF00FF00FF;
+    value = (value | (value << 4)) & 0x0F0F0F0F0F0F0F0F;
+    value = (value | (value << 2)) & 0x3333333333333333;
+    value = (value | (value << 1)) & 0x5555555555555555;
+    return value;
+}
+
+// Interleaves the bits of the two coordinates, so cells close together on the grid mostly
+// get codes close together.
+constexpr uint64_t MortonCode(size_t x, size_t y)
+{
+    return SpreadBits(x) | (SpreadBits(y) << 1);
+}
+
+static_assert(MortonCode(0, 0) == 0);
+static_assert(MortonCode(1, 0) == 1);
+static_assert(MortonCode(0, 1) == 2);
+static_assert(MortonCode(1, 1) == 3);
+static_assert(MortonCode(2, 0) == 4);
+static_assert(MortonCode(3, 3) == 15);
+
+// An object has links of at most this many colors; the rest of its links go in one more
+// color, which is solved by one thread.
+constexpr size_t kLinkColors = 64;
+
+// Colors with fewer links than this are solved without waking the threads.
+constexpr size_t kMinParallelLinks = 256;
+
+// The grid builds keep a row of cells per thread, all rows in one array.
+[[nodiscard]] std::span<uint32_t> TableRow(std::vector<uint32_t>& table, size_t row, size_t row_length)
+{
+    return std::span{table}.subspan(row * row_length, row_length);
+}
 }  // namespace
 
 VerletSolver::VerletSolver()
@@ -39,62 +102,244 @@ VerletSolver::VerletSolver()
     SetThreadsCount(std::thread::hardware_concurrency());
 }
 
-void VerletSolver::SolveCollisions(size_t pass_offset, size_t thread_index, size_t threads_count)
+template <typename Fn>
+void VerletSolver::RunBatch(Fn&& fn)
+{
+    if (substep_executor_.IsRunning())
+    {
+        substep_executor_.RunBatch(std::forward<Fn>(fn));
+    }
+    else
+    {
+        task_scheduler_->RunBatch(std::forward<Fn>(fn));
+    }
+}
+
+void VerletSolver::SolveCollisions(size_t color, size_t thread_index, size_t threads_count)
+{
+    // The awake tiles of a color are split into runs of about the same work, one per thread.
+    // Tiles of one color touch no cell in common, so which thread solves a tile and when does
+    // not change the outcome, and the split need not be the same from one thread count to
+    // another.
+    if (color_tiles_[color].empty()) return;
+
+    SolveCollisionTiles(
+        color,
+        FirstCollisionTileOf(color, thread_index, threads_count),
+        FirstCollisionTileOf(color, thread_index + 1, threads_count));
+}
+
+size_t VerletSolver::FirstCollisionTileOf(size_t color, size_t thread_index, size_t threads_count) const
+{
+    // A thread's run starts at the first tile that ends past its share of the work before it.
+    const std::span work_ends = color_tile_work_ends_[color];
+    if (work_ends.empty()) return 0;
+
+    const uint64_t work_before = work_ends.back() * thread_index / threads_count;
+    return static_cast<size_t>(std::ranges::upper_bound(work_ends, work_before) - work_ends.begin());
+}
+
+std::vector<uint64_t> VerletSolver::GetCollisionWorkSplit(size_t color, size_t threads_count) const
+{
+    const std::span work_ends = color_tile_work_ends_[color];
+    std::vector<uint64_t> split(threads_count, 0);
+    for (const size_t thread_index : std::views::iota(size_t{0}, threads_count))
+    {
+        const size_t first = FirstCollisionTileOf(color, thread_index, threads_count);
+        const size_t last = FirstCollisionTileOf(color, thread_index + 1, threads_count);
+        if (first == last) continue;
+        split[thread_index] = work_ends[last - 1] - (first == 0 ? 0 : work_ends[first - 1]);
+    }
+
+    return split;
+}
+
+void VerletSolver::SolveCollisionTiles(size_t color, size_t first, size_t last)
+{
+    // Every object of a cell is solved against the same cells, so they are copied out once
+    // per cell, in the order the objects are visited in, and written back after.
+    CollisionNeighbours neighbours;
+    for (const uint32_t tile : std::span{color_tiles_[color]}.subspan(first, last - first))
+    {
+        SolveCollisionTile(neighbours, tile);
+    }
+}
+
+void VerletSolver::SolveCollisionTile(CollisionNeighbours& neighbours, size_t tile_index)
 {
-    constexpr float eps = 0.0001f;
-    auto solve_collision_between_object_and_cell =
-        [&](const ObjectId& object_id, VerletObject& object, const size_t origin_cell_index)
+    const std::span positions = objects.Positions();
+    const std::span radii = objects.Radii();
+    const std::span flags = objects.Flags();
+    const CollisionKernels::Function solve_collisions = CollisionKernels::Get(collision_kernel_);
+
+    // The full stencil centers on every cell but the border ones, which it reaches from their
+    // neighbours. The half stencil only reaches forward, so it has to start on the first
+    // column and row to solve the same pairs, and needs no center on the last ones.
+    const bool jacobi = collision_iteration_ == CollisionIteration::Jacobi;
+    const bool half_stencil = !jacobi && collision_stencil_ == CollisionStencil::Half;
+    const auto [begin, end] = TileCells(tile_index, half_stencil ? 0 : 1);
+
+    // Objects of a sleeping tile are listed as fixed: the awake ones around bump into them as
+    // into a wall instead of pushing them where nothing integrates them. Most tiles have no
+    // sleeping tile around them and need not look.
+    const bool sleeping_around = HasSleepingTileAround(tile_index);
+    const size_t grid_width = grid_size_.x();
+    auto fix_if_sleeping = [&](const size_t cell_index, const size_t first, const size_t count)
     {
-        for (const ObjectId& another_object_id : ForEachObjectInCell(origin_cell_index))
+        const Vec2<size_t> cell{cell_index % grid_width, cell_index / grid_width};
+        if (IsTileSleeping(CellToTileIndex(cell))) neighbours.Fix(first, count);
+    };
+
+    for (const size_t cell_y : std::views::iota(begin.y(), end.y()))
+    {
+        for (const size_t cell_x : std::views::iota(begin.x(), end.x()))
         {
-            if (object_id != another_object_id)
+            const size_t cell_index = cell_y * grid_width + cell_x;
+            neighbours.Clear();
+            size_t first_in_cell = 0;
+            size_t count_in_cell = 0;
+            if (broadphase_ == Broadphase::SortedCells)
             {
-                auto& another_object = objects.Get(another_object_id);
-                const Vec2f axis = object.position - another_object.position;
-                const float dist_sq = axis.SquaredLength();
-                if (dist_sq < 1.0f && dist_sq > eps)
+                count_in_cell = cell_count_[cell_index];
+                if (count_in_cell == 0) continue;
+
+                // The half stencil puts the cell first so that each of its objects is solved
+                // against the objects after it and against all of the four cells ahead: right,
+                // above, above right and below right. The nine cells of the full stencil are
+                // three rows of three. Each row is given with the column it starts on.
+                const std::array<std::tuple<size_t, size_t, size_t>, 3> full_stencil{
+                    {{cell_index - 1, cell_index + 1, cell_x - 1},
+                     {cell_index + grid_width - 1, cell_index + grid_width + 1, cell_x - 1},
+                     {cell_index - grid_width - 1, cell_index - grid_width + 1, cell_x - 1}}};
+                const std::array<std::tuple<size_t, size_t, size_t>, 3> half_stencil_rows{
+                    {{cell_index, cell_index + 1, cell_x},
+                     {cell_index + grid_width, cell_index + grid_width + 1, cell_x},
+                     {cell_index - grid_width + 1, cell_index - grid_width + 1, cell_x + 1}}};
+                const std::span rows = half_stencil ? std::span{half_stencil_rows}.first(cell_y != 0 ? 3 : 2)
+                                                    : std::span{full_stencil};
+                if (!half_stencil) first_in_cell = cell_count_[cell_index - 1];
+
+                // The index lays cells out tile by tile, so a row is one run of it unless it
+                // crosses into the next tile, where it is split in two.
+                const size_t tile_first_x = cell_x / kCollisionTileSize * kCollisionTileSize;
+                auto add_run = [&](const size_t first, const size_t last)
+                {
+                    for (const uint32_t index : CellRun(first, last))
+                    {
+                        neighbours.Add(index, positions[index], radii[index], flags[index]);
+                    }
+                };
+                for (const auto& [first, last, first_x] : rows)
                 {
-                    const float dist = std::sqrt(dist_sq);
-                    const float delta = 0.5f - dist / 2;
-                    const Vec2f col_vec = axis * (delta / dist);
-                    const auto [ac, bc] = MassCoefficients(object, another_object);
-                    object.position += ac * col_vec;
-                    another_object.position -= bc * col_vec;
+                    const size_t edge_x = first_x < tile_first_x ? tile_first_x : tile_first_x + kCollisionTileSize;
+                    const size_t split = std::min(first + (edge_x - first_x), last + 1);
+                    size_t listed = neighbours.Size();
+                    if (split != first) add_run(first, split - 1);
+                    if (split <= last) add_run(split, last);
+
+                    if (!sleeping_around) continue;
+                    for (const size_t neighbour_cell : std::views::iota(first, last + 1))
+                    {
+                        fix_if_sleeping(neighbour_cell, listed, cell_count_[neighbour_cell]);
+                        listed += cell_count_[neighbour_cell];
+                    }
+                }
+            }
+            else
+            {
+                if (cell_heads_[cell_index] == kInvalidObjectIndex) continue;
+
+                // Chains are walked a cell at a time, the cell itself first.
+                const std::array<size_t, 9> full_stencil{
+                    cell_index,
+                    cell_index + 1,
+                    cell_index - 1,
+                    cell_index + grid_width,
+                    cell_index + grid_width + 1,
+                    cell_index + grid_width - 1,
+                    cell_index - grid_width,
+                    cell_index - grid_width + 1,
+                    cell_index - grid_width - 1};
+                const std::array<size_t, 5> half_stencil_cells{
+                    cell_index,
+                    cell_index + 1,
+                    cell_index + grid_width,
+                    cell_index + grid_width + 1,
+                    cell_index - grid_width + 1};
+                const std::span stencil = half_stencil
+                                              ? std::span<const size_t>{half_stencil_cells}.first(cell_y != 0 ? 5 : 4)
+                                              : std::span<const size_t>{full_stencil};
+                for (const size_t neighbour_cell : stencil)
+                {
+                    const size_t listed = neighbours.Size();
+                    for (const uint32_t index : ForEachIndexInCell(neighbour_cell))
+                    {
+                        neighbours.Add(index, positions[index], radii[index], flags[index]);
+                    }
+
+                    if (neighbour_cell == cell_index) count_in_cell = neighbours.Size();
+                    if (sleeping_around) fix_if_sleeping(neighbour_cell, listed, neighbours.Size() - listed);
                 }
             }
+
+            if (jacobi)
+            {
+                CollisionKernels::AccumulateCorrections(
+                    neighbours,
+                    first_in_cell,
+                    count_in_cell,
+                    jacobi_displacements_);
+                continue;
+            }
+
+            solve_collisions(neighbours, first_in_cell, count_in_cell, collision_stencil_);
+            neighbours.WriteBack(positions);
         }
-    };
+    }
+}
 
-    // Columns of one pass are kCollisionPassStride apart, so the three columns any of them
-    // touches are touched by no other column of the same pass, and one column is always
-    // walked by one thread. Columns go to threads in fixed index order, so the outcome does
-    // not depend on the thread count.
-    const size_t num_jobs = ChunkSize(grid_size_.x() - 2, kCollisionPassStride, pass_offset);
-    const size_t first_job = ChunkBegin(num_jobs, threads_count, thread_index);
-    const size_t last_job = first_job + ChunkSize(num_jobs, threads_count, thread_index);
+void VerletSolver::SolveCollisionsJacobi()
+{
+    jacobi_displacements_.resize(objects.SlotsCount());
+
+    // Every object's sum is written by the thread that solves its tile alone, in the order the
+    // tile lists its neighbours, so it does not depend on the threads either.
+    RunBatch(
+        [&](const size_t thread_index, const size_t threads_count)
+        {
+            for (const size_t color : std::views::iota(size_t{0}, kCollisionTileColors))
+            {
+                SolveCollisions(color, thread_index, threads_count);
+            }
+        });
 
+    const std::span positions = objects.Positions();
+    const float relaxation = jacobi_relaxation_;
     const size_t grid_width = grid_size_.x();
-    for (const size_t job_index : std::views::iota(first_job, last_job))
-    {
-        const size_t cell_x = 1 + pass_offset + job_index * kCollisionPassStride;
-        for (const size_t cell_y : std::views::iota(size_t{1}, grid_size_.y() - 1))
+    RunBatch(
+        [&](const size_t thread_index, const size_t threads_count)
         {
-            const size_t cell_index = cell_y * grid_width + cell_x;
-            for (const ObjectId& object_id : ForEachObjectInCell(cell_index))
+            const size_t first_tile = ChunkBegin(occupied_tiles_.size(), threads_count, thread_index);
+            const size_t tiles_count = ChunkSize(occupied_tiles_.size(), threads_count, thread_index);
+            for (const uint32_t tile_index : std::span{occupied_tiles_}.subspan(first_tile, tiles_count))
             {
-                auto& object = objects.Get(object_id);
-                solve_collision_between_object_and_cell(object_id, object, cell_index);
-                solve_collision_between_object_and_cell(object_id, object, cell_index + 1);
-                solve_collision_between_object_and_cell(object_id, object, cell_index - 1);
-                solve_collision_between_object_and_cell(object_id, object, cell_index + grid_width);
-                solve_collision_between_object_and_cell(object_id, object, cell_index + grid_width + 1);
-                solve_collision_between_object_and_cell(object_id, object, cell_index + grid_width - 1);
-                solve_collision_between_object_and_cell(object_id, object, cell_index - grid_width);
-                solve_collision_between_object_and_cell(object_id, object, cell_index - grid_width + 1);
-                solve_collision_between_object_and_cell(object_id, object, cell_index - grid_width - 1);
+                if (IsTileSleeping(tile_index)) continue;
+
+                const auto [begin, end] = TileCells(tile_index, 1);
+                for (const size_t cell_y : std::views::iota(begin.y(), end.y()))
+                {
+                    for (const size_t cell_x : std::views::iota(begin.x(), end.x()))
+                    {
+                        for (const uint32_t index : ForEachIndexInCell(cell_y * grid_width + cell_x))
+                        {
+                            Vec2f& displacement = jacobi_displacements_[index];
+                            positions[index] += relaxation * displacement;
+                            displacement = {};
+                        }
+                    }
+                }
             }
-        }
-    }
+        });
 }
 
 void VerletSolver::RebuildGrid()
@@ -105,206 +350,1174 @@ void VerletSolver::RebuildGrid()
         sim_area_changed_ = false;
     }
 
-    std::ranges::fill(cell_heads_, kInvalidObjectIndex);
+    thread_tile_objects_.resize(GetThreadsCount() * tiles_size_.x() * tiles_size_.y(), 0);
+    thread_found_tiles_.resize(GetThreadsCount());
+    thread_coarse_objects_.resize(GetThreadsCount());
+    thread_moved_objects_.resize(GetThreadsCount());
+    switch (broadphase_)
+    {
+    case Broadphase::CellChains:
+        RebuildCellChains();
+        break;
+    case Broadphase::SortedCells:
+        RebuildSortedCells();
+        break;
+    case Broadphase::IncrementalChains:
+        RebuildIncrementalChains();
+        break;
+    }
+
+    RebuildCoarseLevels();
+    ScheduleCollisionTiles();
+}
+
+void VerletSolver::RebuildCoarseLevels()
+{
+    const std::span positions = objects.Positions();
+    const std::span radii = objects.Radii();
 
-    // An object joins its cell at the front, so walking the objects backwards leaves every
-    // chain running forwards.
-    for (auto [id, object] : objects.IdentifiersAndObjects() | std::views::reverse)
+    // Objects sharing a cell are sorted by index, so the list does not depend on how many
+    // threads found them.
+    coarse_objects_.clear();
+    const float max_radius = GetMaxObjectRadius();
+    for (const auto& found : thread_coarse_objects_)
     {
-        const auto cell_index = LocationToCellIndex(object.position);
-        object.next_object_in_cell = cell_heads_[cell_index];
-        cell_heads_[cell_index] = static_cast<uint32_t>(id.GetValue());
+        for (const uint32_t index : found)
+        {
+            klvk::ErrorHandling::Ensure(
+                radii[index] <= max_radius,
+                "Object radius {} is over the largest the grid holds, {}",
+                radii[index],
+                max_radius);
+            const size_t level = GridLevel(radii[index]);
+            const auto cell = LevelCell(LocationToCell(positions[index]), level);
+            coarse_objects_.emplace_back(CoarseCellKey(level, cell), index);
+        }
     }
+
+    std::ranges::sort(coarse_objects_);
+    coarse_moves_.resize(coarse_objects_.size());
 }
 
-VerletSolver::UpdateStats VerletSolver::Update()
+void VerletSolver::SolveCoarseCollisions()
 {
-    update_in_progress_ = true;
-    const auto scope_leave_ = edt::OnScopeLeave([this] { update_in_progress_ = false; });
-    UpdateStats stats{};
-    stats.total = edt::MeasureTime(
-        [&]
+    const std::span positions = objects.Positions();
+    const std::span radii = objects.Radii();
+    const std::span flags = objects.Flags();
+    const CollisionKernels::Function solve_collisions = CollisionKernels::Get(collision_kernel_);
+    auto add = [&](CollisionNeighbours& neighbours, const uint32_t index)
+    {
+        neighbours.Add(index, positions[index], radii[index], flags[index]);
+    };
+
+    CollisionNeighbours neighbours;
+    for (const size_t coarse : std::views::iota(size_t{0}, coarse_objects_.size()))
+    {
+        const uint32_t index = std::get<1>(coarse_objects_[coarse]);
+        const Vec2f position = positions[index];
+        const size_t level = GridLevel(radii[index]);
+        neighbours.Clear();
+        add(neighbours, index);
+
+        // An object of a level that touches this one has its center no further from this
+        // one's edge than the largest radius of the level. Of its own level, only the objects
+        // after it are listed, so that a pair is solved once either way.
+        for (const size_t other_level : std::views::iota(size_t{1}, level + 1))
         {
-            for ([[maybe_unused]] const size_t index : std::views::iota(size_t{0}, kNumSubSteps))
+            const float reach = radii[index] + LevelMaxRadius(other_level);
+            const auto first = LevelCell(LocationToCell(position - reach), other_level);
+            const auto last = LevelCell(LocationToCell(position + reach), other_level);
+            for (const size_t cell_y : std::views::iota(first.y(), last.y() + 1))
             {
-                stats.rebuild_grid += edt::MeasureTime(std::bind_front(&VerletSolver::RebuildGrid, this));
-                stats.apply_links += edt::MeasureTime(std::bind_front(&VerletSolver::ApplyLinks, this));
-                stats.solve_collisions += edt::MeasureTime(
-                    [&]
+                auto begin = std::ranges::lower_bound(
+                    coarse_objects_,
+                    std::tuple{CoarseCellKey(other_level, {first.x(), cell_y}), uint32_t{0}});
+                const auto end = std::ranges::upper_bound(
+                    coarse_objects_,
+                    std::tuple{CoarseCellKey(other_level, {last.x(), cell_y}), kInvalidObjectIndex});
+                if (other_level == level)
+                {
+                    begin = std::max(begin, coarse_objects_.begin() + static_cast<std::ptrdiff_t>(coarse) + 1);
+                }
+                for (const auto& [other_key, other_index] : std::ranges::subrange(begin, std::max(begin, end)))
+                {
+                    add(neighbours, other_index);
+                }
+            }
+        }
+
+        // The cells of the grid are reached the same way. Objects of a sleeping tile are fixed
+        // here as well; a big object moving into them wakes the tile once it has moved.
+        const float reach = radii[index] + GetMaxCellObjectRadius();
+        const auto first = LocationToCell(position - reach);
+        const auto last = LocationToCell(position + reach);
+        for (const size_t cell_y : std::views::iota(first.y(), last.y() + 1))
+        {
+            for (const size_t cell_x : std::views::iota(first.x(), last.x() + 1))
+            {
+                const size_t listed = neighbours.Size();
+                for (const uint32_t other_index : ForEachIndexInCell(CellToCellIndex({cell_x, cell_y})))
+                {
+                    add(neighbours, other_index);
+                }
+
+                const size_t tile_index = CellToTileIndex({cell_x, cell_y});
+                if (IsTileSleeping(tile_index)) neighbours.Fix(listed, neighbours.Size() - listed);
+            }
+        }
+
+        // The full stencil solves a pair of small objects from either side, so a pair with a
+        // big object is solved twice as well, to hold as firmly.
+        const size_t passes = collision_stencil_ == CollisionStencil::Full ? 2 : 1;
+        for ([[maybe_unused]] const size_t pass : std::views::iota(size_t{0}, passes))
+        {
+            solve_collisions(neighbours, 0, 1, CollisionStencil::Half);
+        }
+        neighbours.WriteBack(positions);
+    }
+}
+
+void VerletSolver::ClearTileCells(size_t tile_index)
+{
+    ForEachCellOfTile(
+        tile_index,
+        [&](const size_t cell_index)
+        {
+            cell_heads_[cell_index] = kInvalidObjectIndex;
+            cell_start_[cell_index] = 0;
+            cell_count_[cell_index] = 0;
+        });
+}
+
+void VerletSolver::CollectOccupiedTiles()
+{
+    std::swap(occupied_tiles_, previous_occupied_tiles_);
+    occupied_tiles_.clear();
+
+    // A tile several slices found objects in is summed up by the first of them, which leaves
+    // nothing for the others to find.
+    const size_t rows_count = GetThreadsCount();
+    const size_t tiles_count = tiles_size_.x() * tiles_size_.y();
+    for (const size_t slice : std::views::iota(size_t{0}, rows_count))
+    {
+        for (const uint32_t tile : thread_found_tiles_[slice])
+        {
+            uint32_t tile_objects = 0;
+            for (const size_t other_slice : std::views::iota(slice, rows_count))
+            {
+                tile_objects += std::exchange(thread_tile_objects_[other_slice * tiles_count + tile], 0);
+            }
+            if (tile_objects == 0) continue;
+
+            // Objects spawned, deleted or carried in by something other than the solver change
+            // the count of a tile, which then has to be awake to deal with them.
+            occupied_tiles_.push_back(tile);
+            if (std::exchange(tile_objects_[tile], tile_objects) != tile_objects) tile_quiet_substeps_[tile] = 0;
+        }
+    }
+
+    std::ranges::sort(occupied_tiles_);
+
+    // The build writes every cell of the occupied tiles, so only a tile left empty has to be
+    // cleared. It wakes as well, and forgets how far its objects last moved, as the tiles around
+    // it still look at that.
+    auto occupied = occupied_tiles_.begin();
+    for (const uint32_t tile : previous_occupied_tiles_)
+    {
+        occupied = std::lower_bound(occupied, occupied_tiles_.end(), tile);
+        if (occupied != occupied_tiles_.end() && *occupied == tile) continue;
+
+        ClearTileCells(tile);
+        tile_objects_[tile] = 0;
+        tile_moves_[tile] = 0.f;
+        tile_quiet_substeps_[tile] = 0;
+    }
+}
+
+void VerletSolver::ScheduleCollisionTiles()
+{
+    // A sleeping tile is left off the lists.
+    for (const size_t color : std::views::iota(size_t{0}, kCollisionTileColors))
+    {
+        color_tiles_[color].clear();
+        color_tile_work_ends_[color].clear();
+    }
+
+    for (const uint32_t tile : occupied_tiles_)
+    {
+        if (IsTileSleeping(tile)) continue;
+
+        const size_t color = tile % tiles_size_.x() % 2 + tile / tiles_size_.x() % 2 * 2;
+        auto& work_ends = color_tile_work_ends_[color];
+        color_tiles_[color].push_back(tile);
+        work_ends.push_back((work_ends.empty() ? 0 : work_ends.back()) + tile_objects_[tile]);
+    }
+}
+
+bool VerletSolver::HasSleepingTileAround(size_t tile_index) const
+{
+    const size_t tile_x = tile_index % tiles_size_.x();
+    const size_t tile_y = tile_index / tiles_size_.x();
+    for (const size_t y : std::views::iota(tile_y - std::min(tile_y, size_t{1}), std::min(tile_y + 2, tiles_size_.y())))
+    {
+        for (const size_t x :
+             std::views::iota(tile_x - std::min(tile_x, size_t{1}), std::min(tile_x + 2, tiles_size_.x())))
+        {
+            if (IsTileSleeping(x + y * tiles_size_.x())) return true;
+        }
+    }
+
+    return false;
+}
+
+void VerletSolver::UpdateSleepingTiles()
+{
+    if (!sleeping_enabled_) return;
+
+    // A tile is woken by a move next to its border as much as by one inside it, so it only
+    // counts a quiet substep when none of the nine tiles around it moved. Only tiles with
+    // objects are counted: an empty one is woken by the objects that come into it anyway.
+    const auto tiles_x = static_cast<int64_t>(tiles_size_.x());
+    const auto tiles_y = static_cast<int64_t>(tiles_size_.y());
+    const float threshold_sq = edt::Math::Sqr(kSleepSpeed * GetSubStepSeconds());
+    const uint32_t substeps_to_sleep = SubStepsToSleep();
+    for (const uint32_t tile : occupied_tiles_)
+    {
+        const auto tile_x = static_cast<int64_t>(tile) % tiles_x;
+        const auto tile_y = static_cast<int64_t>(tile) / tiles_x;
+        bool quiet = true;
+        for (const int64_t y : std::views::iota(std::max(tile_y - 1, int64_t{0}), std::min(tile_y + 2, tiles_y)))
+        {
+            for (const int64_t x : std::views::iota(std::max(tile_x - 1, int64_t{0}), std::min(tile_x + 2, tiles_x)))
+            {
+                quiet = quiet && tile_moves_[static_cast<size_t>(x + y * tiles_x)] <= threshold_sq;
+            }
+        }
+
+        tile_quiet_substeps_[tile] = quiet ? std::min(tile_quiet_substeps_[tile] + 1, substeps_to_sleep) : 0;
+    }
+
+    // An object too big for a cell wakes the tiles it moves through, as much as a tile of
+    // small objects moving would.
+    const std::span positions = objects.Positions();
+    const std::span radii = objects.Radii();
+    for (const size_t coarse : std::views::iota(size_t{0}, coarse_objects_.size()))
+    {
+        if (coarse_moves_[coarse] <= threshold_sq) continue;
+        const uint32_t index = std::get<1>(coarse_objects_[coarse]);
+        WakeArea(positions[index], radii[index] + 1.f);
+    }
+}
+
+void VerletSolver::RebuildCellChains()
+{
+    const size_t rows_count = GetThreadsCount();
+    const size_t cells_count = GetGridCellsCount();
+    const size_t tiles_count = tiles_size_.x() * tiles_size_.y();
+    thread_cell_heads_.resize(rows_count * cells_count, kInvalidObjectIndex);
+    thread_cell_tails_.resize(rows_count * cells_count);
+
+    const std::span positions = objects.Positions();
+    const std::span radii = objects.Radii();
+    const float max_cell_radius = GetMaxCellObjectRadius();
+    const std::span flags = objects.Flags();
+    const std::span cell_links = objects.CellLinks();
+
+    // Every thread chains up a slice of the slots on its own. An object joins its cell at the
+    // front, so walking the slice backwards leaves every chain running forwards. Objects too
+    // big for a cell are set aside for the coarse levels.
+    RunBatch(
+        [&](const size_t thread_index, const size_t threads_count)
+        {
+            const auto heads = TableRow(thread_cell_heads_, thread_index, cells_count);
+            const auto tails = TableRow(thread_cell_tails_, thread_index, cells_count);
+            const auto tile_objects = TableRow(thread_tile_objects_, thread_index, tiles_count);
+            auto& found_tiles = thread_found_tiles_[thread_index];
+            auto& coarse_objects = thread_coarse_objects_[thread_index];
+            found_tiles.clear();
+            coarse_objects.clear();
+
+            const size_t slots_count = objects.SlotsCount();
+            const size_t begin = ChunkBegin(slots_count, threads_count, thread_index);
+            const size_t end = begin + ChunkSize(slots_count, threads_count, thread_index);
+            for (const size_t index : std::views::iota(begin, end) | std::views::reverse)
+            {
+                if (!flags[index].alive) continue;
+                if (radii[index] > max_cell_radius)
+                {
+                    coarse_objects.push_back(static_cast<uint32_t>(index));
+                    continue;
+                }
+
+                const auto cell = LocationToCell(positions[index]);
+                const auto cell_index = CellToCellIndex(cell);
+                const size_t tile_index = CellToTileIndex(cell);
+                if (tile_objects[tile_index]++ == 0) found_tiles.push_back(static_cast<uint32_t>(tile_index));
+                if (heads[cell_index] == kInvalidObjectIndex) tails[cell_index] = static_cast<uint32_t>(index);
+                cell_links[index] = heads[cell_index];
+                heads[cell_index] = static_cast<uint32_t>(index);
+            }
+        });
+
+    CollectOccupiedTiles();
+
+    // Slices are in slot order, so joining the pieces of a cell in slice order gives the chain
+    // one thread would have built on its own. Only the cells of occupied tiles have pieces.
+    RunBatch(
+        [&](const size_t thread_index, const size_t threads_count)
+        {
+            const size_t begin = ChunkBegin(occupied_tiles_.size(), threads_count, thread_index);
+            const size_t count = ChunkSize(occupied_tiles_.size(), threads_count, thread_index);
+            for (const uint32_t tile : std::span{occupied_tiles_}.subspan(begin, count))
+            {
+                ForEachCellOfTile(
+                    tile,
+                    [&](const size_t cell_index)
                     {
-                        for (const size_t pass_offset : std::views::iota(size_t{0}, kCollisionPassStride))
+                        uint32_t next = kInvalidObjectIndex;
+                        for (const size_t slice : std::views::iota(size_t{0}, threads_count) | std::views::reverse)
                         {
-                            batch_thread_pool_->RunBatch(
-                                std::bind_front(&VerletSolver::SolveCollisions, this, pass_offset));
+                            const uint32_t head = std::exchange(
+                                thread_cell_heads_[slice * cells_count + cell_index],
+                                kInvalidObjectIndex);
+                            if (head == kInvalidObjectIndex) continue;
+                            cell_links[thread_cell_tails_[slice * cells_count + cell_index]] = next;
+                            next = head;
                         }
+                        cell_heads_[cell_index] = next;
                     });
-                stats.update_positions += edt::MeasureTime(
-                    [&] { batch_thread_pool_->RunBatch(std::bind_front(&VerletSolver::UpdatePositions, this)); });
             }
         });
-
-    return stats;
 }
 
-void VerletSolver::UpdatePositions(size_t thread_index, size_t threads_count)
+void VerletSolver::RebuildSortedCells()
 {
-    constexpr float margin = 2.0f;
-    const auto constraint_with_margin = sim_area_.Enlarged(-margin);
-    constexpr float dt_2 = edt::Math::Sqr(kTimeSubStepDurationSeconds);
+    const size_t rows_count = GetThreadsCount();
+    const size_t cells_count = GetGridCellsCount();
+    const size_t tiles_count = tiles_size_.x() * tiles_size_.y();
+    thread_cell_offsets_.resize(rows_count * cells_count, 0);
+    thread_totals_.resize(rows_count);
+    object_cells_.resize(objects.SlotsCount());
+    sorted_objects_.resize(objects.ObjectsCount());
 
-    const size_t num_columns = grid_size_.x() - 2;
-    const size_t begin_x = 1 + ChunkBegin(num_columns, threads_count, thread_index);
-    const size_t end_x = begin_x + ChunkSize(num_columns, threads_count, thread_index);
+    const std::span positions = objects.Positions();
+    const std::span radii = objects.Radii();
+    const float max_cell_radius = GetMaxCellObjectRadius();
+    const std::span flags = objects.Flags();
 
-    const size_t grid_width = grid_size_.x();
-    for (const size_t cell_x : std::views::iota(begin_x, end_x))
+    auto slots_of_thread = [&](const size_t thread_index, const size_t threads_count)
     {
-        for (const size_t cell_y : std::views::iota(size_t{1}, grid_size_.y() - 1))
+        const size_t slots_count = objects.SlotsCount();
+        const size_t begin = ChunkBegin(slots_count, threads_count, thread_index);
+        return std::views::iota(begin, begin + ChunkSize(slots_count, threads_count, thread_index));
+    };
+
+    auto tiles_of_thread = [&](const size_t thread_index, const size_t threads_count)
+    {
+        const size_t occupied_count = occupied_tiles_.size();
+        const size_t begin = ChunkBegin(occupied_count, threads_count, thread_index);
+        return std::span{occupied_tiles_}.subspan(begin, ChunkSize(occupied_count, threads_count, thread_index));
+    };
+
+    // Every thread counts the objects of a slice of the slots, cell by cell, and sets aside
+    // those too big for a cell.
+    RunBatch(
+        [&](const size_t thread_index, const size_t threads_count)
         {
-            const size_t cell_index = cell_y * grid_width + cell_x;
-            for (auto& object :
-                 ForEachObjectInCell(cell_index) | ObjectTransforms::IdToObject(*this) | ObjectFilters::IsMovable())
+            const auto counts = TableRow(thread_cell_offsets_, thread_index, cells_count);
+            const auto tile_objects = TableRow(thread_tile_objects_, thread_index, tiles_count);
+            auto& found_tiles = thread_found_tiles_[thread_index];
+            auto& coarse_objects = thread_coarse_objects_[thread_index];
+            found_tiles.clear();
+            coarse_objects.clear();
+            for (const size_t index : slots_of_thread(thread_index, threads_count))
             {
-                const auto last_update_move = object.position - object.old_position;
+                if (!flags[index].alive || radii[index] > max_cell_radius)
+                {
+                    if (flags[index].alive) coarse_objects.push_back(static_cast<uint32_t>(index));
+                    object_cells_[index] = kInvalidObjectIndex;
+                    continue;
+                }
 
-                // Save current position
-                object.old_position = object.position;
+                const auto cell = LocationToCell(positions[index]);
+                const auto cell_index = static_cast<uint32_t>(CellToCellIndex(cell));
+                const size_t tile_index = CellToTileIndex(cell);
+                if (tile_objects[tile_index]++ == 0) found_tiles.push_back(static_cast<uint32_t>(tile_index));
+                object_cells_[index] = cell_index;
+                ++counts[cell_index];
+            }
+        });
 
-                // Perform Verlet integration
-                object.position += last_update_move + (gravity - last_update_move * kVelocityDampling) * dt_2;
+    CollectOccupiedTiles();
 
-                // Constraint
-                object.position = constraint_with_margin.Clamp(object.position);
+    // The prefix sum runs over cells first and slices second: each cell gets the objects of
+    // every slice, and within it the objects of one slice follow those of the slices before.
+    // Cells are laid out tile after tile and row by row within a tile, and only the occupied
+    // tiles are laid out at all. Each thread sums a range of tiles, the ranges are offset by
+    // what came before them, and each thread then turns its own counts into where every slice
+    // starts writing.
+    RunBatch(
+        [&](const size_t thread_index, const size_t threads_count)
+        {
+            uint32_t total = 0;
+            for (const uint32_t tile : tiles_of_thread(thread_index, threads_count))
+            {
+                ForEachCellOfTile(
+                    tile,
+                    [&](const size_t cell_index)
+                    {
+                        for (const size_t slice : std::views::iota(size_t{0}, threads_count))
+                        {
+                            total += thread_cell_offsets_[slice * cells_count + cell_index];
+                        }
+                    });
             }
-        }
+            thread_totals_[thread_index] = total;
+        });
+
+    std::exclusive_scan(thread_totals_.begin(), thread_totals_.end(), thread_totals_.begin(), uint32_t{0});
+
+    RunBatch(
+        [&](const size_t thread_index, const size_t threads_count)
+        {
+            uint32_t offset = thread_totals_[thread_index];
+            for (const uint32_t tile : tiles_of_thread(thread_index, threads_count))
+            {
+                ForEachCellOfTile(
+                    tile,
+                    [&](const size_t cell_index)
+                    {
+                        cell_start_[cell_index] = offset;
+                        for (const size_t slice : std::views::iota(size_t{0}, threads_count))
+                        {
+                            uint32_t& slice_offset = thread_cell_offsets_[slice * cells_count + cell_index];
+                            offset += std::exchange(slice_offset, offset);
+                        }
+                        cell_count_[cell_index] = offset - cell_start_[cell_index];
+                    });
+            }
+        });
+
+    // Slices are in slot order and each is scattered in slot order, so every cell lists its
+    // objects in index order, the way a chain would, however many threads there are. Each
+    // thread then empties its row of offsets again, which it only wrote in occupied tiles.
+    RunBatch(
+        [&](const size_t thread_index, const size_t threads_count)
+        {
+            const auto offsets = TableRow(thread_cell_offsets_, thread_index, cells_count);
+            for (const size_t index : slots_of_thread(thread_index, threads_count))
+            {
+                const uint32_t cell_index = object_cells_[index];
+                if (cell_index == kInvalidObjectIndex) continue;
+                sorted_objects_[offsets[cell_index]++] = static_cast<uint32_t>(index);
+            }
+
+            for (const uint32_t tile : occupied_tiles_)
+            {
+                ForEachCellOfTile(tile, [&](const size_t cell_index) { offsets[cell_index] = 0; });
+            }
+        });
+}
+
+void VerletSolver::RebuildIncrementalChains()
+{
+    const size_t slots_count = objects.SlotsCount();
+    const size_t tiles_count = tiles_size_.x() * tiles_size_.y();
+    object_cells_.resize(slots_count, kInvalidObjectIndex);
+    cell_next_.resize(slots_count, kInvalidObjectIndex);
+    cell_prev_.resize(slots_count, kInvalidObjectIndex);
+
+    const std::span positions = objects.Positions();
+    const std::span radii = objects.Radii();
+    const float max_cell_radius = GetMaxCellObjectRadius();
+    const std::span flags = objects.Flags();
+
+    // Every thread bins a slice of the slots as the other builds do, but only writes down the
+    // objects that are not in the cell they are chained in. A dead object or one too big for a
+    // cell is in none. Nothing but the solver moves objects between two substeps of an update,
+    // so the integration may have done this already.
+    if (!std::exchange(binned_ahead_, false))
+    {
+        RunBatch(
+            [&](const size_t thread_index, const size_t threads_count)
+            {
+                const auto tile_objects = TableRow(thread_tile_objects_, thread_index, tiles_count);
+                auto& found_tiles = thread_found_tiles_[thread_index];
+                auto& coarse_objects = thread_coarse_objects_[thread_index];
+                auto& moved_objects = thread_moved_objects_[thread_index];
+                found_tiles.clear();
+                coarse_objects.clear();
+                moved_objects.clear();
+
+                const size_t begin = ChunkBegin(slots_count, threads_count, thread_index);
+                const size_t end = begin + ChunkSize(slots_count, threads_count, thread_index);
+                for (const size_t index : std::views::iota(begin, end))
+                {
+                    uint32_t cell_index = kInvalidObjectIndex;
+                    if (flags[index].alive && radii[index] > max_cell_radius)
+                    {
+                        coarse_objects.push_back(static_cast<uint32_t>(index));
+                    }
+                    else if (flags[index].alive)
+                    {
+                        const auto cell = LocationToCell(positions[index]);
+                        const size_t tile_index = CellToTileIndex(cell);
+                        if (tile_objects[tile_index]++ == 0) found_tiles.push_back(static_cast<uint32_t>(tile_index));
+                        cell_index = static_cast<uint32_t>(CellToCellIndex(cell));
+                    }
+
+                    if (cell_index != object_cells_[index])
+                    {
+                        moved_objects.emplace_back(static_cast<uint32_t>(index), cell_index);
+                    }
+                }
+            });
+    }
+
+    // Relinking touches the cells on both sides of every move, which the slices share, and
+    // there are few moves, so one thread makes them all.
+    for (const auto& moved_objects : thread_moved_objects_)
+    {
+        for (const auto& [index, cell_index] : moved_objects) MoveToCell(index, cell_index);
     }
+
+    CollectOccupiedTiles();
 }
 
-void VerletSolver::DeleteAll()
+void VerletSolver::MoveToCell(const uint32_t index, const uint32_t cell_index)
 {
-    linked_to.clear();
-    linked_by.clear();
-    objects.Clear();
+    if (const uint32_t old_cell_index = object_cells_[index]; old_cell_index != kInvalidObjectIndex)
+    {
+        const uint32_t next = cell_next_[index];
+        const uint32_t previous = cell_prev_[index];
+        (previous == kInvalidObjectIndex ? cell_heads_[old_cell_index] : cell_next_[previous]) = next;
+        if (next != kInvalidObjectIndex) cell_prev_[next] = previous;
+    }
+
+    object_cells_[index] = cell_index;
+    if (cell_index == kInvalidObjectIndex) return;
+
+    // A cell holds a handful of objects at most, so finding the place of this one in index
+    // order is a short walk.
+    uint32_t previous = kInvalidObjectIndex;
+    uint32_t next = cell_heads_[cell_index];
+    while (next != kInvalidObjectIndex && next < index)
+    {
+        previous = std::exchange(next, cell_next_[next]);
+    }
+
+    cell_next_[index] = next;
+    cell_prev_[index] = previous;
+    (previous == kInvalidObjectIndex ? cell_heads_[cell_index] : cell_next_[previous]) = index;
+    if (next != kInvalidObjectIndex) cell_prev_[next] = index;
 }
 
-void VerletSolver::DeleteObject(ObjectId to_delete)
+void VerletSolver::ResetIncrementalChains()
 {
-    if (auto linked_by_it = linked_by.find(to_delete); linked_by_it != linked_by.end())
+    for (const uint32_t tile : occupied_tiles_) ClearTileCells(tile);
+    object_cells_.assign(objects.SlotsCount(), kInvalidObjectIndex);
+}
+
+void VerletSolver::CompactObjects()
+{
+    // The freed objects leave their chains before their slots are filled or dropped. Slots
+    // past the end of the chains' arrays were taken after the last build and are in no chain.
+    const bool incremental = broadphase_ == Broadphase::IncrementalChains;
+    if (incremental)
+    {
+        for (const uint32_t hole : objects.FreeSlots())
+        {
+            if (hole < object_cells_.size()) MoveToCell(hole, kInvalidObjectIndex);
+        }
+    }
+
+    if (link_rows_outdated_ && !links_.empty()) RebuildLinkRows();
+
+    const auto moves = objects.Compact();
+    for (const auto& [from, to] : moves)
     {
-        for (auto& other : linked_by_it->second)
+        if (incremental && from < object_cells_.size())
         {
-            auto& v = linked_to[other];
-            auto [b, e] = std::ranges::remove(v, to_delete, &VerletSolver::VerletLink::other);
-            v.erase(b, e);
+            const uint32_t cell_index = object_cells_[from];
+            MoveToCell(from, kInvalidObjectIndex);
+            MoveToCell(to, cell_index);
         }
 
-        linked_by.erase(linked_by_it);
+        for (const uint32_t link_index : ObjectLinks(from))
+        {
+            VerletLink& link = links_[link_index];
+            if (link.from == from) link.from = to;
+            if (link.to == from) link.to = to;
+        }
+    }
+
+    if (!moves.empty() && !links_.empty())
+    {
+        link_rows_outdated_ = true;
+        link_colors_outdated_ = true;
+    }
+}
+
+VerletSolver::UpdateStats VerletSolver::Update()
+{
+    update_in_progress_ = true;
+    const auto scope_leave_ = edt::OnScopeLeave([this] { update_in_progress_ = false; });
+    UpdateStats stats{};
+
+    // Deleting leaves the holes where they are until now: tools walk the cells while they
+    // delete, and a cell walked past a moved object would lead into the chain of another.
+    if (objects.IsDenseEnabled() && !objects.FreeSlots().empty()) CompactObjects();
+
+    const auto update = [&]
+    {
+        DispatchSubSteps([&](auto substeps) { UpdateSubSteps<substeps()>(stats); });
+    };
+
+    // A single thread has no one to wait for.
+    if (persistent_workers_ && GetThreadsCount() > 1)
+    {
+        stats.total = edt::MeasureTime([&] { substep_executor_.RunFrame(*task_scheduler_, update); });
+        stats.barrier_wait = std::ranges::max(substep_executor_.GetThreadWaits());
+    }
+    else
+    {
+        stats.total = edt::MeasureTime(update);
     }
 
-    if (auto linked_to_it = linked_to.find(to_delete); linked_to_it != linked_to.end())
+    for (const uint32_t tile : occupied_tiles_)
     {
-        for (auto& link : linked_to_it->second)
+        if (IsTileSleeping(tile)) stats.sleeping_objects += tile_objects_[tile];
+    }
+
+    return stats;
+}
+
+template <size_t kSubSteps>
+void VerletSolver::UpdateSubSteps(UpdateStats& stats)
+{
+    const size_t substeps = kSubSteps == 0 ? substeps_ : kSubSteps;
+    const bool bin_while_integrating = fused_binning_ && broadphase_ == Broadphase::IncrementalChains;
+    thread_max_moves_.resize(GetThreadsCount());
+    float max_move_sq = 0.f;
+    for ([[maybe_unused]] const size_t index : std::views::iota(size_t{0}, substeps))
+    {
+        stats.rebuild_grid += edt::MeasureTime(std::bind_front(&VerletSolver::RebuildGrid, this));
+        stats.apply_links += edt::MeasureTime(std::bind_front(&VerletSolver::ApplyLinks, this));
+        stats.solve_collisions += edt::MeasureTime(
+            [&]
+            {
+                if (collision_iteration_ == CollisionIteration::Jacobi)
+                {
+                    SolveCollisionsJacobi();
+                }
+                else
+                {
+                    // Every thread starts on a run of about the same work. On the pool, threads
+                    // that find their run quick to solve steal halves of the others' as they go;
+                    // the persistent workers have no one to steal from and keep their runs.
+                    for (const size_t color : std::views::iota(size_t{0}, kCollisionTileColors))
+                    {
+                        if (substep_executor_.IsRunning())
+                        {
+                            RunBatch(std::bind_front(&VerletSolver::SolveCollisions, this, color));
+                        }
+                        else
+                        {
+                            task_scheduler_->RunBatch(
+                                [&](const size_t slice_index, const size_t slices_count)
+                                {
+                                    task_scheduler_->ParallelFor(
+                                        FirstCollisionTileOf(color, slice_index, slices_count),
+                                        FirstCollisionTileOf(color, slice_index + 1, slices_count),
+                                        1,
+                                        std::bind_front(&VerletSolver::SolveCollisionTiles, this, color));
+                                });
+                        }
+                    }
+                }
+                SolveCoarseCollisions();
+            });
+
+        // Every substep but the last is followed by a grid build within the update.
+        const bool bin_ahead = bin_while_integrating && index + 1 != substeps;
+        auto& positions_time = bin_ahead ? stats.integrate_and_bin : stats.update_positions;
+        positions_time += edt::MeasureTime(
+            [&]
+            {
+                RunBatch(
+                    bin_ahead ? std::bind_front(&VerletSolver::UpdatePositions<kSubSteps, true>, this)
+                              : std::bind_front(&VerletSolver::UpdatePositions<kSubSteps, false>, this));
+                max_move_sq = std::max(max_move_sq, std::ranges::max(thread_max_moves_));
+                UpdateSleepingTiles();
+            });
+        binned_ahead_ = bin_ahead;
+    }
+
+    stats.substeps = substeps;
+    if (config_.adaptive_substeps) AdaptSubSteps(max_move_sq);
+}
+
+void VerletSolver::AdaptSubSteps(const float max_move_sq)
+{
+    // The fastest object would have covered its move of a substep as many times over a frame,
+    // and it takes that many allowed moves to get there at the same speed. A scene that sped
+    // up within the frame is caught up with in the next one.
+    const float frame_move = std::sqrt(max_move_sq) * static_cast<float>(substeps_);
+    const float allowed_move = config_.max_substep_move * GetMaxCellObjectRadius();
+    const auto needed = static_cast<size_t>(std::ceil(frame_move / allowed_move));
+    substeps_ = std::clamp(std::bit_ceil(std::max(needed, size_t{1})), config_.min_substeps, config_.max_substeps);
+}
+
+void VerletSolver::UpdatePositions(size_t thread_index, size_t threads_count)
+{
+    DispatchSubSteps([&](auto substeps) { UpdatePositions<substeps()>(thread_index, threads_count); });
+}
+
+template <size_t kSubSteps, bool kBinAhead>
+void VerletSolver::UpdatePositions(size_t thread_index, size_t threads_count)
+{
+    constexpr float margin = 2.0f;
+    const auto constraint_with_margin = sim_area_.Enlarged(-margin);
+
+    // The config is copied out before the loop: positions are floats too, and the compiler
+    // would otherwise have to read it again after every object it moves.
+    const float substeps = static_cast<float>(kSubSteps == 0 ? substeps_ : kSubSteps);
+    const float dt_2 = edt::Math::Sqr(config_.time_step_seconds / substeps);
+    const Vec2f gravity = config_.gravity;
+    const float velocity_damping = config_.velocity_damping;
+
+    // Objects are moved tile by tile, so that the tiles that sleep can be skipped and the
+    // others can note how far their objects went. Empty tiles are not even looked at.
+    const size_t first_tile = ChunkBegin(occupied_tiles_.size(), threads_count, thread_index);
+    const size_t tiles_count = ChunkSize(occupied_tiles_.size(), threads_count, thread_index);
+
+    const std::span positions = objects.Positions();
+    const std::span old_positions = objects.OldPositions();
+    const std::span flags = objects.Flags();
+
+    // Returns the squared length of the move.
+    auto integrate = [&](const size_t index)
+    {
+        if (!flags[index].movable) return 0.f;
+
+        Vec2f& position = positions[index];
+        Vec2f& old_position = old_positions[index];
+        const auto last_update_move = position - old_position;
+
+        // Save current position
+        old_position = position;
+
+        // Perform Verlet integration
+        position += last_update_move + (gravity - last_update_move * velocity_damping) * dt_2;
+
+        // Constraint
+        position = constraint_with_margin.Clamp(position);
+
+        // An object pressed against the border is pushed out of the area and put back every
+        // substep without getting anywhere, which is no reason to stay awake, so the move is
+        // measured from inside the area.
+        return (position - constraint_with_margin.Clamp(old_position)).SquaredLength();
+    };
+
+    // Binning ahead walks the objects of sleeping tiles as well: they are not integrated, but
+    // links may have moved them.
+    const size_t all_tiles_count = tiles_size_.x() * tiles_size_.y();
+    const auto tile_objects =
+        kBinAhead ? TableRow(thread_tile_objects_, thread_index, all_tiles_count) : std::span<uint32_t>{};
+    auto& found_tiles = thread_found_tiles_[thread_index];
+    auto& moved_objects = thread_moved_objects_[thread_index];
+    if constexpr (kBinAhead)
+    {
+        found_tiles.clear();
+        moved_objects.clear();
+    }
+    auto bin = [&](const size_t index)
+    {
+        const auto cell = LocationToCell(positions[index]);
+        const size_t tile_index = CellToTileIndex(cell);
+        if (tile_objects[tile_index]++ == 0) found_tiles.push_back(static_cast<uint32_t>(tile_index));
+        const auto cell_index = static_cast<uint32_t>(CellToCellIndex(cell));
+        if (cell_index != object_cells_[index]) moved_objects.emplace_back(static_cast<uint32_t>(index), cell_index);
+    };
+
+    const size_t grid_width = grid_size_.x();
+    float thread_max_move_sq = 0.f;
+    for (const uint32_t tile_index : std::span{occupied_tiles_}.subspan(first_tile, tiles_count))
+    {
+        float max_move_sq = 0.f;
+        const bool sleeping = IsTileSleeping(tile_index);
+        const auto [begin, end] = TileCells(tile_index, 1);
+        for (const size_t cell_y : std::views::iota(begin.y(), sleeping && !kBinAhead ? begin.y() : end.y()))
         {
-            auto& v = linked_by[link.other];
-            auto [b, e] = std::ranges::remove(v, to_delete);
-            v.erase(b, e);
+            for (const size_t cell_x : std::views::iota(begin.x(), end.x()))
+            {
+                const size_t cell_index = cell_y * grid_width + cell_x;
+                for (const uint32_t index : ForEachIndexInCell(cell_index))
+                {
+                    if (!sleeping) max_move_sq = std::max(max_move_sq, integrate(index));
+                    if constexpr (kBinAhead) bin(index);
+                }
+            }
         }
+
+        tile_moves_[tile_index] = max_move_sq;
+        thread_max_move_sq = std::max(thread_max_move_sq, max_move_sq);
+    }
+
+    // Objects too big for a cell are in no tile and never sleep.
+    const size_t first_coarse = ChunkBegin(coarse_objects_.size(), threads_count, thread_index);
+    const size_t coarse_count = ChunkSize(coarse_objects_.size(), threads_count, thread_index);
+    for (const size_t coarse : std::views::iota(first_coarse, first_coarse + coarse_count))
+    {
+        coarse_moves_[coarse] = integrate(std::get<1>(coarse_objects_[coarse]));
+        thread_max_move_sq = std::max(thread_max_move_sq, coarse_moves_[coarse]);
+    }
+
+    thread_max_moves_[thread_index] = thread_max_move_sq;
+}
+
+ObjectIdRemap VerletSolver::ReorderObjects()
+{
+    klvk::ErrorHandling::Ensure(!update_in_progress_, "Attempt to reorder objects while update is in progress");
+
+    // Objects sharing a cell keep the order they had, so reordering twice in a row changes
+    // nothing the second time.
+    const std::span positions = objects.Positions();
+    std::vector<std::tuple<uint64_t, uint32_t>> keyed;
+    keyed.reserve(objects.ObjectsCount());
+    for (const size_t index : objects.LiveSlots())
+    {
+        const auto cell = LocationToCell(positions[index]);
+        keyed.emplace_back(MortonCode(cell.x(), cell.y()), static_cast<uint32_t>(index));
+    }
+    std::ranges::sort(keyed);
+
+    std::vector<ObjectId> order;
+    std::vector<uint32_t> new_indices(objects.SlotsCount(), kInvalidObjectIndex);
+    order.reserve(keyed.size());
+    for (const auto& [code, index] : keyed)
+    {
+        new_indices[index] = static_cast<uint32_t>(order.size());
+        order.push_back(objects.IdAt(index));
+    }
+
+    ObjectIdRemap remap = objects.Reorder(order);
+    if (broadphase_ == Broadphase::IncrementalChains) ResetIncrementalChains();
+
+    // Links keep the order they were made in, so they are colored the same way after.
+    for (VerletLink& link : links_)
+    {
+        if (link.from == kInvalidObjectIndex) continue;
+        link.from = new_indices[link.from];
+        link.to = new_indices[link.to];
+    }
+    link_rows_outdated_ = !links_.empty();
+    link_colors_outdated_ = !links_.empty();
+
+    // The cells still name the objects by where they were, and tools walk them between updates.
+    RebuildGrid();
+    if (numa_placement_) std::ignore = PlaceOnNumaNodes();
+
+    return remap;
+}
+
+void VerletSolver::DeleteAll()
+{
+    links_.clear();
+    color_links_.clear();
+    color_link_lambdas_.clear();
+    color_link_ends_.clear();
+    link_offsets_.clear();
+    object_links_.clear();
+    link_rows_outdated_ = false;
+    link_colors_outdated_ = false;
+    objects.Clear();
+    if (broadphase_ == Broadphase::IncrementalChains) ResetIncrementalChains();
+}
+
+void VerletSolver::DeleteObject(ObjectId to_delete)
+{
+    if (!links_.empty())
+    {
+        if (link_rows_outdated_) RebuildLinkRows();
+        for (const uint32_t link : ObjectLinks(objects.IndexOf(to_delete))) links_[link].from = kInvalidObjectIndex;
+        link_colors_outdated_ = true;
     }
 
-    linked_to.erase(to_delete);
     objects.Free(to_delete);
 }
 
 void VerletSolver::StabilizeChain(ObjectId first)
 {
-    std::vector queue{first};
-    ankerl::unordered_dense::set<ObjectId, klvk::TaggedIdentifierHash<ObjectId>> visited;
+    if (link_rows_outdated_) RebuildLinkRows();
+
+    std::vector queue{objects.IndexOf(first)};
+    std::vector<bool> visited(objects.SlotsCount());
 
     while (!queue.empty())
     {
-        ObjectId id = queue.back();
+        const size_t index = queue.back();
         queue.pop_back();
 
-        if (!visited.emplace(id).second)
+        if (visited[index])
         {
             continue;
         }
+        visited[index] = true;
 
-        if (auto it = linked_to.find(id); it != linked_to.end())
-        {
-            std::ranges::copy(
-                it->second | std::views::transform(std::mem_fn(&VerletSolver::VerletLink::other)),
-                std::back_inserter(queue));
-        }
-
-        if (auto it = linked_by.find(id); it != linked_by.end())
+        for (const uint32_t link_index : ObjectLinks(index))
         {
-            std::ranges::copy(it->second, std::back_inserter(queue));
+            const VerletLink& link = links_[link_index];
+            if (link.from == kInvalidObjectIndex) continue;
+            queue.push_back(link.from == index ? link.to : link.from);
         }
 
-        auto& object = objects.Get(id);
+        auto object = objects.ObjectAt(index);
         object.old_position = object.position;
     }
 }
 
-std::tuple<float, float> VerletSolver::MassCoefficients(const VerletObject& a, const VerletObject& b)
+void VerletSolver::RebuildLinkRows()
 {
-    const float min_distance = a.GetRadius() + b.GetRadius();
-    if (a.movable)
+    std::erase_if(links_, [](const VerletLink& link) { return link.from == kInvalidObjectIndex; });
+
+    // A counting sort of the links by object, every link counted on both of its objects.
+    link_offsets_.assign(objects.SlotsCount() + 1, 0);
+    for (const VerletLink& link : links_)
     {
-        if (b.movable)
-        {
-            return {a.GetRadius() / min_distance, b.GetRadius() / min_distance};
-        }
-        else
+        ++link_offsets_[link.from + 1];
+        ++link_offsets_[link.to + 1];
+    }
+    std::partial_sum(link_offsets_.begin(), link_offsets_.end(), link_offsets_.begin());
+
+    std::vector<uint32_t> row_ends(link_offsets_.begin(), std::prev(link_offsets_.end()));
+    object_links_.resize(2 * links_.size());
+    for (const size_t link_index : std::views::iota(size_t{0}, links_.size()))
+    {
+        const VerletLink& link = links_[link_index];
+        object_links_[row_ends[link.from]++] = static_cast<uint32_t>(link_index);
+        object_links_[row_ends[link.to]++] = static_cast<uint32_t>(link_index);
+    }
+
+    link_rows_outdated_ = false;
+}
+
+void VerletSolver::RebuildLinkColors()
+{
+    RebuildLinkRows();
+
+    // Every link takes the lowest color neither of its objects has a link of yet, in the order
+    // the links were made, so the colors do not depend on the threads. An object with more
+    // links than there are colors puts the rest in a color of its own, whose links may share
+    // objects and which is solved by one thread.
+    std::vector<uint64_t> object_colors(objects.SlotsCount());
+    std::vector<uint8_t> link_colors(links_.size());
+    std::array<uint32_t, kLinkColors + 1> color_sizes{};
+    for (const size_t link_index : std::views::iota(size_t{0}, links_.size()))
+    {
+        const VerletLink& link = links_[link_index];
+        const uint64_t taken = object_colors[link.from] | object_colors[link.to];
+        const auto color = static_cast<size_t>(std::countr_one(taken));
+        if (color != kLinkColors)
         {
-            return {1.f, 0.f};
+            object_colors[link.from] |= uint64_t{1} << color;
+            object_colors[link.to] |= uint64_t{1} << color;
         }
+
+        link_colors[link_index] = static_cast<uint8_t>(color);
+        ++color_sizes[color];
     }
-    else if (b.movable)
+
+    size_t colors_count = color_sizes.size();
+    while (colors_count != 0 && color_sizes[colors_count - 1] == 0) --colors_count;
+    color_link_ends_.resize(colors_count);
+    std::inclusive_scan(color_sizes.begin(), color_sizes.begin() + colors_count, color_link_ends_.begin());
+
+    std::array<uint32_t, kLinkColors + 1> color_offsets{};
+    std::exclusive_scan(color_sizes.begin(), color_sizes.end(), color_offsets.begin(), uint32_t{0});
+    color_links_.resize(links_.size());
+    color_link_lambdas_.resize(links_.size());
+    for (const size_t link_index : std::views::iota(size_t{0}, links_.size()))
     {
-        return {0.f, 1.f};
+        color_links_[color_offsets[link_colors[link_index]]++] = links_[link_index];
     }
 
-    return {0.f, 0.f};
+    link_colors_outdated_ = false;
 }
 
 void VerletSolver::ApplyLinks()
 {
-    for (const auto& [object_id, links] : linked_to)
+    if (link_colors_outdated_) RebuildLinkColors();
+
+    switch (config_.link_model)
     {
-        VerletObject& a = objects.Get(object_id);
+    case LinkModel::Positional:
+        IterateLinks<LinkModel::Positional>();
+        break;
+    case LinkModel::Xpbd:
+        // What the links have pushed adds up over the iterations of one substep only.
+        std::ranges::fill(color_link_lambdas_, 0.f);
+        IterateLinks<LinkModel::Xpbd>();
+        break;
+    }
+}
 
-        for (const auto& link : links)
+template <LinkModel kModel>
+void VerletSolver::IterateLinks()
+{
+    for ([[maybe_unused]] const size_t iteration : std::views::iota(size_t{0}, config_.link_iterations))
+    {
+        for (const size_t color : std::views::iota(size_t{0}, color_link_ends_.size()))
         {
-            VerletObject& b = objects.Get(link.other);
+            const size_t begin = color == 0 ? 0 : color_link_ends_[color - 1];
+            const size_t count = color_link_ends_[color] - begin;
 
-            Vec2f axis = a.position - b.position;
-            const float distance = std::sqrt(axis.SquaredLength());
-            axis /= distance;
-            const float min_distance = a.GetRadius() + b.GetRadius();
-            const float delta = std::max(min_distance, link.target_distance) - distance;
+            // Waking the threads costs more than a few hundred links take to solve.
+            if (color == kLinkColors || count < kMinParallelLinks)
+            {
+                SolveLinks<kModel>(begin, count);
+                continue;
+            }
 
-            auto [ka, kb] = MassCoefficients(a, b);
-            a.position += ka * delta * axis;
-            b.position -= kb * delta * axis;
+            RunBatch(
+                [&](const size_t thread_index, const size_t threads_count)
+                {
+                    SolveLinks<kModel>(
+                        begin + ChunkBegin(count, threads_count, thread_index),
+                        ChunkSize(count, threads_count, thread_index));
+                });
         }
     }
 }
 
+template <LinkModel kModel>
+void VerletSolver::SolveLinks(const size_t begin, const size_t count)
+{
+    const std::span positions = objects.Positions();
+    const std::span radii = objects.Radii();
+    const std::span flags = objects.Flags();
+    const auto links = std::span{color_links_}.subspan(begin, count);
+
+    // Compliance is per unit of force, which over a substep moves an object by dt^2 per unit.
+    [[maybe_unused]] const float inverse_dt_2 = 1.f / edt::Math::Sqr(GetSubStepSeconds());
+
+    for (const size_t index : std::views::iota(size_t{0}, links.size()))
+    {
+        const VerletLink& link = links[index];
+        Vec2f& a = positions[link.from];
+        Vec2f& b = positions[link.to];
+
+        Vec2f axis = a - b;
+        const float distance = std::sqrt(axis.SquaredLength());
+        axis /= distance;
+        const float min_distance = radii[link.from] + radii[link.to];
+        float delta = std::max(min_distance, link.target_distance) - distance;
+
+        auto [ka, kb] =
+            CollisionKernels::MassCoefficients(flags[link.from], radii[link.from], flags[link.to], radii[link.to]);
+
+        if constexpr (kModel == LinkModel::Xpbd)
+        {
+            // The objects' shares stand in for their inverse masses, so a rigid link moves
+            // them exactly as the positional one does. Two fixed objects have nothing to move.
+            const float alpha = link.compliance * inverse_dt_2;
+            const float denominator = ka + kb + alpha;
+            if (denominator == 0.f) continue;
+
+            float& lambda = color_link_lambdas_[begin + index];
+            delta = (delta - alpha * lambda) / denominator;
+            lambda += delta;
+        }
+
+        a += ka * delta * axis;
+        b -= kb * delta * axis;
+    }
+}
+
 size_t VerletSolver::GetThreadsCount() const
 {
-    return batch_thread_pool_->GetThreadsCount();
+    return task_scheduler_->GetThreadsCount();
 }
 
 void VerletSolver::SetThreadsCount(size_t count)
 {
-    if (!batch_thread_pool_ || count != GetThreadsCount())
+    if (!task_scheduler_ || count != GetThreadsCount())
     {
-        batch_thread_pool_ = std::make_unique<edt::BatchThreadPool>(count);
+        task_scheduler_ = std::make_unique<TaskScheduler>(count, thread_pinning_);
     }
 }
 
+void VerletSolver::SetThreadPinningEnabled(bool enabled)
+{
+    klvk::ErrorHandling::Ensure(!update_in_progress_, "Attempt to toggle thread pinning while update is in progress");
+    if (enabled == thread_pinning_) return;
+    thread_pinning_ = enabled;
+    task_scheduler_ = std::make_unique<TaskScheduler>(GetThreadsCount(), thread_pinning_);
+}
+
+void VerletSolver::SetNumaPlacementEnabled(bool enabled)
+{
+    klvk::ErrorHandling::Ensure(!update_in_progress_, "Attempt to toggle NUMA placement while update is in progress");
+    numa_placement_ = enabled;
+}
+
+PagePlacement VerletSolver::PlaceOnNumaNodes()
+{
+    klvk::ErrorHandling::Ensure(!update_in_progress_, "Attempt to place memory while update is in progress");
+    if (NumaTopology::Get().NodesCount() < 2 || occupied_tiles_.empty()) return {};
+    if (!task_scheduler_->AreThreadsPinned()) return {};
+
+    // A tile is integrated by the thread its place among the occupied tiles falls to, which
+    // with persistent workers is always the same thread; a tile that holds nothing goes with
+    // the occupied one after it. The first thread is the one waiting on the pool, which can
+    // run on any node, so its tiles have none.
+    const size_t threads_count = GetThreadsCount();
+    auto tile_node = [&](const size_t tile_index) -> std::optional<size_t>
+    {
+        const auto found = std::ranges::lower_bound(occupied_tiles_, tile_index);
+        const auto position = static_cast<size_t>(found - occupied_tiles_.begin());
+        const size_t last = occupied_tiles_.size() - 1;
+        const size_t thread_index = ChunkIndex(last + 1, threads_count, std::min(position, last));
+        if (thread_index == 0) return std::nullopt;
+        return task_scheduler_->GetThreadNode(thread_index);
+    };
+
+    const std::span<const Vec2f> positions = objects.Positions();
+    auto slot_node = [&](const size_t index) -> std::optional<size_t>
+    {
+        if (positions.empty()) return std::nullopt;
+        return tile_node(CellToTileIndex(LocationToCell(positions[std::min(index, positions.size() - 1)])));
+    };
+    auto cell_node = [&](const size_t cell_index)
+    {
+        return tile_node(CellToTileIndex({cell_index % grid_size_.x(), cell_index / grid_size_.x()}));
+    };
+
+    PagePlacement placement;
+    auto place = [&]<typename T>(std::span<const T> array, auto&& element_node)
+    {
+        const PagePlacement array_placement =
+            PlacePages(std::as_bytes(array), [&](const size_t offset) { return element_node(offset / sizeof(T)); });
+        placement.pages += array_placement.pages;
+        placement.placed_pages += array_placement.placed_pages;
+    };
+
+    const ObjectPool& pool = objects;
+    place(pool.Positions(), slot_node);
+    place(pool.OldPositions(), slot_node);
+    place(pool.Flags(), slot_node);
+    place(pool.Radii(), slot_node);
+    place(pool.CellLinks(), slot_node);
+    place(std::span<const uint32_t>{cell_next_}, slot_node);
+    place(std::span<const uint32_t>{cell_prev_}, slot_node);
+    place(std::span<const uint32_t>{object_cells_}, slot_node);
+    place(std::span<const Vec2f>{jacobi_displacements_}, slot_node);
+    place(std::span<const uint32_t>{cell_heads_}, cell_node);
+    place(std::span<const uint32_t>{cell_start_}, cell_node);
+    place(std::span<const uint32_t>{cell_count_}, cell_node);
+    return placement;
+}
+
 void VerletSolver::SetSimArea(const edt::FloatRange2Df& sim_area)
 {
     klvk::ErrorHandling::Ensure(!update_in_progress_, "Attempt to change simulation area while update is in progress");
@@ -315,25 +1528,186 @@ void VerletSolver::SetSimArea(const edt::FloatRange2Df& sim_area)
     }
 }
 
+void VerletSolver::SetConfig(const SolverConfig& config)
+{
+    klvk::ErrorHandling::Ensure(!update_in_progress_, "Attempt to change solver config while update is in progress");
+    klvk::ErrorHandling::Ensure(config.substeps > 0, "Solver config must have at least one substep");
+    klvk::ErrorHandling::Ensure(
+        config.min_substeps > 0 && config.min_substeps <= config.max_substeps,
+        "Solver substeps must range from at least one up, got {} to {}",
+        config.min_substeps,
+        config.max_substeps);
+    klvk::ErrorHandling::Ensure(
+        config.max_substep_move > 0.f,
+        "Solver max substep move must be positive, got {}",
+        config.max_substep_move);
+    klvk::ErrorHandling::Ensure(
+        config.time_step_seconds > 0.f,
+        "Solver time step must be positive, got {}",
+        config.time_step_seconds);
+    klvk::ErrorHandling::Ensure(config.cell_size > 0.f, "Solver cell size must be positive, got {}", config.cell_size);
+    klvk::ErrorHandling::Ensure(config.link_iterations > 0, "Solver config must have at least one link iteration");
+    klvk::ErrorHandling::Ensure(
+        config.link_compliance >= 0.f,
+        "Solver link compliance must not be negative, got {}",
+        config.link_compliance);
+
+    const bool cell_size_changed = config.cell_size != config_.cell_size;
+    config_ = config;
+    substeps_ = config_.adaptive_substeps
+                    ? std::clamp(config_.substeps, config_.min_substeps, config_.max_substeps)
+                    : config_.substeps;
+    WakeAll();
+
+    // Tools walk the cells between updates, so the grid has to be in its new form at once.
+    if (cell_size_changed)
+    {
+        sim_area_changed_ = true;
+        RebuildGrid();
+    }
+}
+
 void VerletSolver::UpdateGridSize()
 {
-    grid_size_ = Vec2<size_t>{2, 2} + sim_area_.Extent().Cast<size_t>() / cell_size;
-    cell_heads_.resize(grid_size_.x() * grid_size_.y());
+    grid_size_ = Vec2<size_t>{2, 2} + (sim_area_.Extent() / config_.cell_size).Cast<size_t>();
+    const size_t cells_count = grid_size_.x() * grid_size_.y();
+    cell_heads_.assign(cells_count, kInvalidObjectIndex);
+    cell_start_.assign(cells_count, 0);
+    cell_count_.assign(cells_count, 0);
+
+    tiles_size_ = Vec2<size_t>{
+        (grid_size_.x() + kCollisionTileSize - 1) / kCollisionTileSize,
+        (grid_size_.y() + kCollisionTileSize - 1) / kCollisionTileSize};
+    const size_t tiles_count = tiles_size_.x() * tiles_size_.y();
+    tile_objects_.assign(tiles_count, 0);
+    tile_moves_.assign(tiles_count, 0.f);
+    tile_quiet_substeps_.assign(tiles_count, 0);
+
+    // The tiles are numbered anew, and every cell starts out empty.
+    occupied_tiles_.clear();
+    object_cells_.assign(objects.SlotsCount(), kInvalidObjectIndex);
+}
+
+void VerletSolver::SetCollisionKernel(CollisionKernel kernel)
+{
+    klvk::ErrorHandling::Ensure(
+        !update_in_progress_,
+        "Attempt to change collision kernel while update is in progress");
+    klvk::ErrorHandling::Ensure(
+        CollisionKernels::IsSupported(kernel),
+        "Collision kernel {} is not supported here",
+        magic_enum::enum_name(kernel));
+    collision_kernel_ = kernel;
+}
+
+void VerletSolver::SetCollisionStencil(CollisionStencil stencil)
+{
+    klvk::ErrorHandling::Ensure(
+        !update_in_progress_,
+        "Attempt to change collision stencil while update is in progress");
+    collision_stencil_ = stencil;
+}
+
+void VerletSolver::SetCollisionIteration(CollisionIteration iteration)
+{
+    klvk::ErrorHandling::Ensure(
+        !update_in_progress_,
+        "Attempt to change collision iteration while update is in progress");
+    collision_iteration_ = iteration;
+}
+
+void VerletSolver::SetJacobiRelaxation(float relaxation)
+{
+    klvk::ErrorHandling::Ensure(
+        relaxation > 0.f && relaxation < 2.f,
+        "Jacobi relaxation must be between 0 and 2, got {}",
+        relaxation);
+    jacobi_relaxation_ = relaxation;
+}
+
+void VerletSolver::SetSleepingEnabled(bool enabled)
+{
+    klvk::ErrorHandling::Ensure(!update_in_progress_, "Attempt to toggle sleeping while update is in progress");
+    sleeping_enabled_ = enabled;
+    if (!enabled) WakeAll();
+}
+
+void VerletSolver::SetFusedBinningEnabled(bool enabled)
+{
+    klvk::ErrorHandling::Ensure(
+        !update_in_progress_,
+        "Attempt to toggle fused binning while update is in progress");
+    fused_binning_ = enabled;
+}
+
+void VerletSolver::SetPersistentWorkersEnabled(bool enabled)
+{
+    klvk::ErrorHandling::Ensure(
+        !update_in_progress_,
+        "Attempt to toggle persistent workers while update is in progress");
+    persistent_workers_ = enabled;
+}
+
+void VerletSolver::WakeArea(const Vec2f& center, float radius)
+{
+    // A grid about to be resized starts out with every tile awake anyway.
+    if (sim_area_changed_) return;
+
+    const auto min_cell = LocationToCell(center - radius);
+    const auto max_cell = LocationToCell(center + radius);
+    for (const size_t tile_y :
+         std::views::iota(min_cell.y() / kCollisionTileSize, max_cell.y() / kCollisionTileSize + 1))
+    {
+        for (const size_t tile_x :
+             std::views::iota(min_cell.x() / kCollisionTileSize, max_cell.x() / kCollisionTileSize + 1))
+        {
+            tile_quiet_substeps_[tile_x + tile_y * tiles_size_.x()] = 0;
+        }
+    }
+}
+
+void VerletSolver::WakeAll()
+{
+    std::ranges::fill(tile_quiet_substeps_, uint32_t{0});
+}
+
+void VerletSolver::SetBroadphase(Broadphase broadphase)
+{
+    klvk::ErrorHandling::Ensure(!update_in_progress_, "Attempt to change broadphase while update is in progress");
+    if (broadphase == broadphase_) return;
+    broadphase_ = broadphase;
+
+    // A build only writes its own layout, so the cells the other one left have to go, and an
+    // incremental build has to start from none.
+    ResetIncrementalChains();
+
+    // Tools walk the cells between updates, so the grid has to be in its new form at once.
+    RebuildGrid();
 }
 
 VerletSolver::~VerletSolver()
 {
-    batch_thread_pool_ = nullptr;
+    task_scheduler_ = nullptr;
 }
 
 void VerletSolver::CreateLink(ObjectId from, ObjectId to, float target_distance)
 {
-    linked_to[from].push_back({
+    CreateLink(from, to, target_distance, config_.link_compliance);
+}
+
+void VerletSolver::CreateLink(ObjectId from, ObjectId to, float target_distance, float compliance)
+{
+    klvk::ErrorHandling::Ensure(from != to, "Attempt to link object {} to itself", from.GetValue());
+    klvk::ErrorHandling::Ensure(compliance >= 0.f, "Link compliance must not be negative, got {}", compliance);
+    links_.push_back({
+        .from = static_cast<uint32_t>(objects.IndexOf(from)),
+        .to = static_cast<uint32_t>(objects.IndexOf(to)),
         .target_distance = target_distance,
-        .other = to,
+        .compliance = compliance,
     });
 
-    linked_by[to].push_back(from);
+    link_rows_outdated_ = true;
+    link_colors_outdated_ = true;
 }
 
 }  // namespace verlet
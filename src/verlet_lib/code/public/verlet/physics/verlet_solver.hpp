@@ -1,24 +1,43 @@
 #pragma once
 
-#include <ankerl/unordered_dense.h>
-
+#include <array>
 #include <cassert>
 #include <edt/math/float_range.hpp>
 #include <edt/time/measure_time.hpp>
+#include <type_traits>
 
 #include "edt/math/math.hpp"
 #include "edt/math/matrix.hpp"
 #include "edt/template/overload.hpp"
-#include "klvk/template/tagged_id_hash.hpp"
+#include "klvk/integral_aliases.hpp"
 #include "verlet/object_pool.hpp"
+#include "verlet/physics/collision_kernels.hpp"
+#include "verlet/physics/solver_config.hpp"
+#include "verlet/physics/substep_executor.hpp"
+#include "verlet/threading/numa.hpp"
 
-namespace edt
+namespace verlet
 {
-class BatchThreadPool;
-}
 
-namespace verlet
+class TaskScheduler;
+
+// How the grid remembers which objects are in a cell.
+enum class Broadphase : u8
 {
+    // Each cell names its first object and each object the next one in its cell. Cheap to
+    // build, but every step along a cell is a load that depends on the one before.
+    CellChains,
+
+    // A counting sort lays the objects out cell after cell in one index, so a cell is a run
+    // of it and a row of neighbouring cells within a collision tile is one run as well.
+    SortedCells,
+
+    // Chains as above, linked both ways and kept from one build to the next: a build only
+    // relinks the objects that left their cell. Most objects stay in theirs between two
+    // substeps, so a build writes little besides the tile counts, and the cells list their
+    // objects in the same order the rebuilt chains do.
+    IncrementalChains,
+};
 
 class VerletSolver
 {
@@ -29,34 +48,68 @@ public:
         std::chrono::nanoseconds rebuild_grid;
         std::chrono::nanoseconds solve_collisions;
         std::chrono::nanoseconds update_positions;
+
+        // Substeps that bin the objects for the next one as they integrate them count here
+        // rather than under update_positions.
+        std::chrono::nanoseconds integrate_and_bin;
         std::chrono::nanoseconds total;
+
+        // Objects in sleeping tiles when the update ended.
+        size_t sleeping_objects;
+
+        // The substeps the frame was split into, which adaptive substeps pick anew every frame.
+        size_t substeps;
+
+        // With persistent workers, the longest any thread spent waiting at the barriers
+        // between passes. GetThreadBarrierWaits() has every thread's.
+        std::chrono::nanoseconds barrier_wait;
     };
 
+    // Holds two objects no closer than target_distance. A deleted object's links are marked
+    // dead by setting from to kInvalidObjectIndex and are dropped at the next rebuild. The
+    // compliance is what the link gives under LinkModel::Xpbd; the positional model ignores it.
     struct VerletLink
     {
+        uint32_t from = kInvalidObjectIndex;
+        uint32_t to = kInvalidObjectIndex;
         float target_distance{};
-        ObjectId other{};
+        float compliance{};
     };
 
-    // A cell keeps only the first of its objects; each object names the next one, so the
-    // chain is walked rather than indexed.
+    // The slots of the objects a cell holds, however the grid keeps them: either a chain
+    // threaded through the objects, where the cell knows only the first and each object names
+    // the next, or a run of the grid's sorted index.
     class CellObjects : public std::ranges::view_interface<CellObjects>
     {
     public:
         class Iterator
         {
         public:
-            using value_type = ObjectId;
+            using value_type = uint32_t;
             using difference_type = std::ptrdiff_t;
 
             Iterator() = default;
-            Iterator(const ObjectPool* pool, uint32_t index) : pool_{pool}, index_{index} {}
+            Iterator(const uint32_t* links, uint32_t index) : links_{links}, index_{index} {}
+            Iterator(const uint32_t* run, const uint32_t* run_end)
+                : run_{run},
+                  run_end_{run_end},
+                  index_{run == run_end ? kInvalidObjectIndex : *run}
+            {
+            }
 
-            [[nodiscard]] ObjectId operator*() const { return ObjectId::FromValue(index_); }
+            [[nodiscard]] uint32_t operator*() const { return index_; }
 
             Iterator& operator++()
             {
-                index_ = pool_->Get(ObjectId::FromValue(index_)).next_object_in_cell;
+                if (links_)
+                {
+                    index_ = links_[index_];
+                }
+                else
+                {
+                    ++run_;
+                    index_ = run_ == run_end_ ? kInvalidObjectIndex : *run_;
+                }
                 return *this;
             }
 
@@ -65,42 +118,71 @@ public:
             [[nodiscard]] bool operator==(std::default_sentinel_t) const { return index_ == kInvalidObjectIndex; }
 
         private:
-            const ObjectPool* pool_ = nullptr;
+            const uint32_t* links_ = nullptr;
+            const uint32_t* run_ = nullptr;
+            const uint32_t* run_end_ = nullptr;
             uint32_t index_ = kInvalidObjectIndex;
         };
 
         CellObjects() = default;
-        CellObjects(const ObjectPool& pool, uint32_t first) : pool_{&pool}, first_{first} {}
+        CellObjects(std::span<const uint32_t> links, uint32_t first) : links_{links.data()}, first_{first} {}
+        explicit CellObjects(std::span<const uint32_t> run) : run_{run} {}
 
-        [[nodiscard]] Iterator begin() const { return Iterator{pool_, first_}; }
+        [[nodiscard]] Iterator begin() const
+        {
+            return links_ ? Iterator{links_, first_} : Iterator{run_.data(), run_.data() + run_.size()};
+        }
         [[nodiscard]] std::default_sentinel_t end() const { return {}; }  // NOLINT
 
     private:
-        const ObjectPool* pool_ = nullptr;
+        const uint32_t* links_ = nullptr;
         uint32_t first_ = kInvalidObjectIndex;
+        std::span<const uint32_t> run_;
     };
 
-    static constexpr float kVelocityDampling = 40.f;  // arbitrary, approximating air friction
-    static constexpr edt::Vec2f gravity{0.0f, -20.f};
-    static constexpr Vec2<size_t> cell_size{1, 1};
-    static constexpr size_t kCollisionPassStride = 3;
-    static constexpr float kTimeStepDurationSeconds = 1.f / 60.f;
-    static constexpr size_t kNumSubSteps = 8;
-    static constexpr float kTimeSubStepDurationSeconds = kTimeStepDurationSeconds / static_cast<float>(kNumSubSteps);
+    // Collisions are solved tile by tile. A tile's color is the parity of its column and row,
+    // so two tiles of one color always have a whole tile between them, and as long as a tile
+    // is wider than the one cell a stencil reaches past it, no two of them touch the same cell.
+    static constexpr size_t kCollisionTileSize = 8;
+    static constexpr size_t kCollisionTileColors = 4;
+    static_assert(kCollisionTileSize >= 2);
+
+    // A tile falls asleep once neither its objects nor those of the tiles around it have moved
+    // faster than kSleepSpeed, in world units per second, for kFramesToSleep frames in a row. A
+    // sleeping tile is neither integrated nor solved; it wakes when a tile around it moves or
+    // when its objects change.
+    static constexpr float kSleepSpeed = 1.f;
+    static constexpr uint32_t kFramesToSleep = 4;
+
+    // A cell holds objects up to half its size, so that the cells around an object's own reach
+    // every object it can touch. A bigger object goes into a coarser level of the grid, level L
+    // having cells 2^L wide, so a few big objects never make the cells of all the small ones
+    // coarse. There are few enough of them that the levels are a sorted list of the objects
+    // and the cells they are in rather than grids of their own, which would grow with the
+    // world. The last level holds objects up to GetMaxObjectRadius().
+    static constexpr size_t kGridLevels = 8;
 
     VerletSolver();
     VerletSolver(const VerletSolver&) = delete;
     VerletSolver(VerletSolver&&) = delete;
     ~VerletSolver();
 
-    [[nodiscard]] CellObjects ForEachObjectInCell(const size_t cell_index) const
+    [[nodiscard]] CellObjects ForEachIndexInCell(const size_t cell_index) const
+    {
+        if (broadphase_ == Broadphase::SortedCells) return CellObjects{CellRun(cell_index, cell_index)};
+        if (broadphase_ == Broadphase::IncrementalChains) return CellObjects{cell_next_, cell_heads_[cell_index]};
+        return CellObjects{objects.CellLinks(), cell_heads_[cell_index]};
+    }
+
+    [[nodiscard]] auto ForEachObjectInCell(const size_t cell_index) const
     {
-        return CellObjects{objects, cell_heads_[cell_index]};
+        return ForEachIndexInCell(cell_index) |
+               std::views::transform([this](const uint32_t index) { return objects.IdAt(index); });
     }
 
     [[nodiscard]] Vec2<size_t> LocationToCell(const Vec2f& location) const
     {
-        return ((sim_area_.Clamp(location) - sim_area_.Min()).Cast<size_t>() / cell_size);
+        return ((sim_area_.Clamp(location) - sim_area_.Min()) / config_.cell_size).Cast<size_t>();
     }
 
     [[nodiscard]] size_t LocationToCellIndex(const Vec2f& location) const
@@ -117,7 +199,7 @@ public:
     {
         [[nodiscard]] static auto IdToObject(VerletSolver& solver)
         {
-            return std::views::transform([&](const ObjectId& id) -> VerletObject& { return solver.objects.Get(id); });
+            return std::views::transform([&](const ObjectId& id) { return solver.objects.Get(id); });
         }
     };
 
@@ -125,7 +207,7 @@ public:
     {
         [[nodiscard]] static auto IsMovable()
         {
-            constexpr auto is_movable = [](const VerletObject& object)
+            constexpr auto is_movable = [](const ConstVerletObject object)
             {
                 return object.IsMovable();
             };
@@ -133,13 +215,13 @@ public:
             return std::views::filter(
                 edt::Overload{
                     is_movable,
-                    [](const std::tuple<ObjectId, const VerletObject&> id_and_obj)
+                    [](const std::tuple<ObjectId, ConstVerletObject>& id_and_obj)
                     { return std::get<1>(id_and_obj).movable; }});
         }
 
         [[nodiscard]] static auto InArea(Vec2f position, float radius)
         {
-            auto is_close_enough = [position, rsq = edt::Math::Sqr(radius)](const VerletObject& object)
+            auto is_close_enough = [position, rsq = edt::Math::Sqr(radius)](const ConstVerletObject object)
             {
                 return (position - object.position).SquaredLength() < rsq;
             };
@@ -147,7 +229,7 @@ public:
             return std::views::filter(
                 edt::Overload{
                     is_close_enough,
-                    [=](const std::tuple<ObjectId, const VerletObject&> id_and_obj)
+                    [=](const std::tuple<ObjectId, ConstVerletObject>& id_and_obj)
                     { return is_close_enough(std::get<1>(id_and_obj)); }});
         }
     };
@@ -155,41 +237,446 @@ public:
     UpdateStats Update();
     void ApplyLinks();
     void RebuildGrid();
-    void SolveCollisions(size_t pass_offset, size_t thread_index, size_t threads_count);
+    void SolveCollisions(size_t color, size_t thread_index, size_t threads_count);
     void UpdatePositions(size_t thread_index, size_t threads_count);
 
+    // Objects are stored in the order they were spawned, which after a while has nothing to do
+    // with where they are, and walking a cell's neighbours then jumps all over the pool. This
+    // stores them along a Morton curve through the grid instead, so objects close in the world
+    // are close in memory, and drops the holes deletions left. Every id held from before has to
+    // go through the returned remap.
+    ObjectIdRemap ReorderObjects();
+
     void DeleteObject(ObjectId id);
     void DeleteAll();
     void StabilizeChain(ObjectId first);
+
+    // A link made without a compliance of its own takes the one of the config.
     void CreateLink(ObjectId from, ObjectId to, float target_distance);
+    void CreateLink(ObjectId from, ObjectId to, float target_distance, float compliance);
 
     [[nodiscard]] size_t GetThreadsCount() const;
     void SetThreadsCount(size_t count);
 
+    // The pool the solver runs on, for everything else that runs alongside it to share. A new
+    // thread count replaces it.
+    [[nodiscard]] TaskScheduler& GetTaskScheduler() { return *task_scheduler_; }
+
+    // Pinned threads are spread over the NUMA nodes in blocks and kept on a core of theirs.
+    [[nodiscard]] bool IsThreadPinningEnabled() const { return thread_pinning_; }
+    void SetThreadPinningEnabled(bool enabled);
+
+    // Moves the memory of every object, and of every cell of the grid, to the NUMA node of
+    // the thread that integrates its tile, as of the last grid build. Only pinned threads
+    // stay on a node, so nothing moves while pinning is off, and the tiles of the thread that
+    // waits on the pool, which is not the pool's to pin, stay where they are. Only persistent
+    // workers keep a tile on one thread from pass to pass, so that is where it pays. The pool
+    // grows on the thread that spawns, into memory of that thread's node, so a world that
+    // grew wants placing again. With NUMA placement on, ReorderObjects places the memory it
+    // has just moved. Returns how many pages it asked to move and how many ended up on their
+    // node, both zero when there was nothing to place.
+    [[nodiscard]] PagePlacement PlaceOnNumaNodes();
+    [[nodiscard]] bool IsNumaPlacementEnabled() const { return numa_placement_; }
+    void SetNumaPlacementEnabled(bool enabled);
+
     [[nodiscard]] size_t GetGridCellsCount() const { return cell_heads_.size(); }
 
+    // How many objects each of threads_count threads starts out solving collisions for in the
+    // awake tiles of a color, as they were scheduled for the last substep. Persistent workers
+    // keep to these runs; the pool's threads steal halves of each other's from there.
+    [[nodiscard]] std::vector<uint64_t> GetCollisionWorkSplit(size_t color, size_t threads_count) const;
+
+    // The objects too big for a cell, which no cell lists, as of the last grid build.
+    [[nodiscard]] auto ForEachCoarseObject() const
+    {
+        return coarse_objects_ |
+               std::views::transform([this](const auto& key_and_index)
+                                     { return objects.IdAt(std::get<1>(key_and_index)); });
+    }
+
+    // Starts out as CollisionKernels::Preferred(); they all land on the same positions.
+    [[nodiscard]] CollisionKernel GetCollisionKernel() const { return collision_kernel_; }
+    void SetCollisionKernel(CollisionKernel kernel);
+
+    // Off unless asked for: awake objects treat sleeping ones as fixed, which changes what a
+    // simulation comes to.
+    [[nodiscard]] bool IsSleepingEnabled() const { return sleeping_enabled_; }
+    void SetSleepingEnabled(bool enabled);
+
+    // With fused binning, every substep of an update but the last works out the cell of each
+    // object as it integrates it, and the next substep's grid build relinks the objects that
+    // moved without sweeping the pool again. Only incremental chains outlive a build, so the
+    // other broadphases ignore it. The objects end up where they would without it.
+    [[nodiscard]] bool IsFusedBinningEnabled() const { return fused_binning_; }
+    void SetFusedBinningEnabled(bool enabled);
+
+    // With persistent workers, an update holds every thread of the pool at once: the calling
+    // thread runs it and hands every pass of every substep to the others through a spin
+    // barrier, where otherwise each pass is queued on the pool for its threads to take and
+    // waited for. The objects end up where they would without it.
+    [[nodiscard]] bool IsPersistentWorkersEnabled() const { return persistent_workers_; }
+    void SetPersistentWorkersEnabled(bool enabled);
+
+    // How long each thread waited at the barriers in the last update run with persistent
+    // workers: the first one for the others to finish a pass, the others for the next pass.
+    [[nodiscard]] std::span<const std::chrono::nanoseconds> GetThreadBarrierWaits() const
+    {
+        return substep_executor_.GetThreadWaits();
+    }
+
+    // Tools that move objects without allocating or freeing any have to wake the tiles they
+    // touched, or the objects around stay asleep where they were.
+    void WakeArea(const Vec2f& center, float radius);
+    void WakeAll();
+
+    [[nodiscard]] Broadphase GetBroadphase() const { return broadphase_; }
+    void SetBroadphase(Broadphase broadphase);
+
+    [[nodiscard]] CollisionStencil GetCollisionStencil() const { return collision_stencil_; }
+    void SetCollisionStencil(CollisionStencil stencil);
+
+    // Jacobi iteration always gathers the full stencil, as an object has to hear from every
+    // object it overlaps, and solves the objects too big for a cell the Gauss-Seidel way once
+    // the others are done. The relaxation scales the summed corrections before they are
+    // applied; above one it makes up for the smaller share a pass closes, and at two or more
+    // the pass overshoots for good.
+    [[nodiscard]] CollisionIteration GetCollisionIteration() const { return collision_iteration_; }
+    void SetCollisionIteration(CollisionIteration iteration);
+    [[nodiscard]] float GetJacobiRelaxation() const { return jacobi_relaxation_; }
+    void SetJacobiRelaxation(float relaxation);
+
     [[nodiscard]] const edt::FloatRange2Df& GetSimArea() const { return sim_area_; }
     void SetSimArea(const edt::FloatRange2Df& sim_area);
 
+    // Takes effect from the next update on and wakes every tile, since a pile at rest under
+    // one gravity is not under another.
+    [[nodiscard]] const SolverConfig& GetConfig() const { return config_; }
+    void SetConfig(const SolverConfig& config);
+
+    // The substeps the next frame will take, and how long each of them is.
+    [[nodiscard]] size_t GetSubStepsCount() const { return substeps_; }
+    [[nodiscard]] float GetSubStepSeconds() const
+    {
+        return config_.time_step_seconds / static_cast<float>(substeps_);
+    }
+
+    [[nodiscard]] float GetMaxCellObjectRadius() const { return config_.cell_size / 2; }
+    [[nodiscard]] float GetMaxObjectRadius() const { return LevelMaxRadius(kGridLevels - 1); }
+
     ObjectPool objects;
 
 private:
-    static std::tuple<float, float> MassCoefficients(const VerletObject& a, const VerletObject& b);
     void UpdateGridSize();
+    void RebuildCellChains();
+    void RebuildSortedCells();
+    void RebuildIncrementalChains();
+
+    // Unlinks an object from the cell it is chained in, if any, and links it into another one,
+    // or into none for kInvalidObjectIndex, after the objects of lower index.
+    void MoveToCell(uint32_t index, uint32_t cell_index);
+
+    // Empties the cells of the occupied tiles and forgets which cell every object is chained
+    // in, so that the next incremental build chains them all anew. Anything that renumbers the
+    // cells or the objects has to call it.
+    void ResetIncrementalChains();
+
+    // Fills the holes of a dense pool with the objects at its end. The few objects that move
+    // take their links and their place in the incremental chains with them, rather than having
+    // every object chained anew.
+    void CompactObjects();
+
+    // Empties the cells of a tile in both layouts of the grid.
+    void ClearTileCells(size_t tile_index);
+
+    // Sorts the objects too big for a cell, which every slice of the grid build set aside, by
+    // level and cell.
+    void RebuildCoarseLevels();
+
+    // Solves every object too big for a cell against the objects on its own level and the finer
+    // ones it reaches, one object after the other.
+    void SolveCoarseCollisions();
+
+    // The substep loop and the integration are built for the common substep counts, which
+    // then are as much a constant to them as before the count could be configured. Zero stands
+    // for any other count.
+    template <size_t kSubSteps>
+    void UpdateSubSteps(UpdateStats& stats);
+
+    // With kBinAhead the objects are also counted per tile and their moves out of their cells
+    // written down, as the sweep of an incremental build would.
+    template <size_t kSubSteps, bool kBinAhead = false>
+    void UpdatePositions(size_t thread_index, size_t threads_count);
+
+    // Runs fn(thread_index, threads_count) on every thread, through the executor while an
+    // update runs on it and through the pool otherwise.
+    template <typename Fn>
+    void RunBatch(Fn&& fn);
+
+    template <typename Fn>
+    void DispatchSubSteps(Fn&& fn) const
+    {
+        switch (substeps_)
+        {
+        case 1:
+            return fn(std::integral_constant<size_t, 1>{});
+        case 2:
+            return fn(std::integral_constant<size_t, 2>{});
+        case 4:
+            return fn(std::integral_constant<size_t, 4>{});
+        case 8:
+            return fn(std::integral_constant<size_t, 8>{});
+        case 16:
+            return fn(std::integral_constant<size_t, 16>{});
+        default:
+            return fn(std::integral_constant<size_t, 0>{});
+        }
+    }
+
+    // The level an object of this size goes in, 0 being the cells of the grid.
+    [[nodiscard]] size_t GridLevel(float radius) const
+    {
+        size_t level = 0;
+        while (radius > LevelMaxRadius(level)) ++level;
+        return level;
+    }
+
+    [[nodiscard]] float LevelMaxRadius(size_t level) const
+    {
+        return GetMaxCellObjectRadius() * static_cast<float>(size_t{1} << level);
+    }
+
+    // A cell of a coarse level is 2^level cells of the grid wide. Its key puts the level first
+    // and the row before the column, so the cells of a row of a level are a run of keys.
+    [[nodiscard]] static Vec2<size_t> LevelCell(const Vec2<size_t>& cell, size_t level)
+    {
+        return {cell.x() >> level, cell.y() >> level};
+    }
+
+    [[nodiscard]] static uint64_t CoarseCellKey(size_t level, const Vec2<size_t>& level_cell)
+    {
+        return (uint64_t{level} << 56) | (uint64_t{level_cell.y()} << 28) | uint64_t{level_cell.x()};
+    }
+
+    // Sums what every slice of the grid build counted in the tiles it found objects in, lists
+    // the tiles that have any, and wakes those whose objects changed.
+    void CollectOccupiedTiles();
+
+    // Lists the awake tiles of each color and works out how much work they are, so that the
+    // threads can split them evenly.
+    void ScheduleCollisionTiles();
+
+    // Where on the list of a color's awake tiles the run of a thread starts.
+    [[nodiscard]] size_t FirstCollisionTileOf(size_t color, size_t thread_index, size_t threads_count) const;
+
+    // Counts another quiet substep for the tiles that had one and wakes those that did not.
+    void UpdateSleepingTiles();
+
+    // Solves every color of links, as many times as the config iterates them.
+    template <LinkModel kModel>
+    void IterateLinks();
+
+    // Solves count links of color_links_ from begin, all of them of one color.
+    template <LinkModel kModel>
+    void SolveLinks(size_t begin, size_t count);
+
+    // Drops dead links and lists the links of every object anew.
+    void RebuildLinkRows();
+
+    // Splits the links into colors, lowest color first, so that no color has two links on
+    // one object.
+    void RebuildLinkColors();
+
+    // The links an object is on, dead ones included, as of the last rebuild of the rows.
+    [[nodiscard]] std::span<const uint32_t> ObjectLinks(const size_t index) const
+    {
+        if (index + 1 >= link_offsets_.size()) return {};
+        const size_t begin = link_offsets_[index];
+        return std::span{object_links_}.subspan(begin, link_offsets_[index + 1] - begin);
+    }
+
+    // Picks the substeps of the next frame from the furthest any object moved in a substep of
+    // this one.
+    void AdaptSubSteps(float max_move_sq);
+
+    [[nodiscard]] bool IsTileSleeping(size_t tile_index) const
+    {
+        return tile_quiet_substeps_[tile_index] >= SubStepsToSleep();
+    }
+
+    [[nodiscard]] uint32_t SubStepsToSleep() const
+    {
+        return kFramesToSleep * static_cast<uint32_t>(substeps_);
+    }
+
+    [[nodiscard]] bool HasSleepingTileAround(size_t tile_index) const;
+
+    // The cells of a tile, left out those before first and those on the last row and column.
+    [[nodiscard]] std::tuple<Vec2<size_t>, Vec2<size_t>> TileCells(size_t tile_index, size_t first) const
+    {
+        const size_t tile_x = tile_index % tiles_size_.x() * kCollisionTileSize;
+        const size_t tile_y = tile_index / tiles_size_.x() * kCollisionTileSize;
+        return {
+            Vec2<size_t>{std::max(tile_x, first), std::max(tile_y, first)},
+            Vec2<size_t>{
+                std::min(tile_x + kCollisionTileSize, grid_size_.x() - 1),
+                std::min(tile_y + kCollisionTileSize, grid_size_.y() - 1)}};
+    }
+
+    // Calls fn with every cell of a tile, those on the border of the grid included, row by row.
+    template <typename Fn>
+    void ForEachCellOfTile(size_t tile_index, Fn&& fn) const
+    {
+        const size_t tile_x = tile_index % tiles_size_.x() * kCollisionTileSize;
+        const size_t tile_y = tile_index / tiles_size_.x() * kCollisionTileSize;
+        for (const size_t cell_y : std::views::iota(tile_y, std::min(tile_y + kCollisionTileSize, grid_size_.y())))
+        {
+            for (const size_t cell_x :
+                 std::views::iota(tile_x, std::min(tile_x + kCollisionTileSize, grid_size_.x())))
+            {
+                fn(cell_y * grid_size_.x() + cell_x);
+            }
+        }
+    }
+
+    // Solves the awake tiles of a color from first to last on its list.
+    void SolveCollisionTiles(size_t color, size_t first, size_t last);
+    void SolveCollisionTile(CollisionNeighbours& neighbours, size_t tile_index);
+
+    // One Jacobi pass over every awake tile: the corrections are summed by all threads at
+    // once, then applied by all threads at once.
+    void SolveCollisionsJacobi();
+
+    [[nodiscard]] size_t CellToTileIndex(const Vec2<size_t>& cell) const
+    {
+        return cell.x() / kCollisionTileSize + cell.y() / kCollisionTileSize * tiles_size_.x();
+    }
+
+    // The objects of the cells first to last, in index order: a run of the sorted index, as
+    // long as the cells are on one row of one tile.
+    [[nodiscard]] std::span<const uint32_t> CellRun(const size_t first, const size_t last) const
+    {
+        const size_t begin = cell_start_[first];
+        return std::span{sorted_objects_}.subspan(begin, cell_start_[last] + cell_count_[last] - begin);
+    }
 
 private:
+    SolverConfig config_;
+    size_t substeps_ = config_.substeps;
     edt::FloatRange2Df sim_area_ = {.x = {.begin = -100, .end = 100}, .y = {.begin = -100, .end = 100}};
     bool sim_area_changed_ = true;
 
     bool update_in_progress_ = false;
     Vec2<size_t> grid_size_;
 
-    std::vector<uint32_t> cell_heads_;
-    std::unique_ptr<edt::BatchThreadPool> batch_thread_pool_;
+    Broadphase broadphase_ = Broadphase::CellChains;
+    CollisionKernel collision_kernel_ = CollisionKernels::Preferred();
+    CollisionStencil collision_stencil_ = CollisionStencil::Full;
+    CollisionIteration collision_iteration_ = CollisionIteration::GaussSeidel;
+    float jacobi_relaxation_ = 1.f;
 
-    // links
-    ankerl::unordered_dense::map<ObjectId, std::vector<VerletLink>, klvk::TaggedIdentifierHash<ObjectId>> linked_to;
-    ankerl::unordered_dense::map<ObjectId, std::vector<ObjectId>, klvk::TaggedIdentifierHash<ObjectId>> linked_by;
+    // Per slot, what a Jacobi pass has summed for the object to move by; zero between passes.
+    std::vector<Vec2f> jacobi_displacements_;
+
+    // Broadphase::CellChains and Broadphase::IncrementalChains. Rebuilt chains are linked
+    // through the pool; incremental ones through cell_next_ and back through cell_prev_, both
+    // per slot, so that the pool handing out a slot does not cut the chain it is still on.
+    // For them, object_cells_ is the cell an object is chained in.
+    std::vector<uint32_t> cell_heads_;
+    std::vector<uint32_t> cell_next_;
+    std::vector<uint32_t> cell_prev_;
+
+    // Broadphase::SortedCells. The objects of a cell are cell_count_ entries of
+    // sorted_objects_ from cell_start_, in the order of their ids, the cells laid out tile by
+    // tile and row by row within a tile; the cells of empty tiles start at 0. object_cells_ is
+    // per slot, the cell an object was counted in, kept so the scatter need not work it out
+    // again.
+    std::vector<uint32_t> cell_start_;
+    std::vector<uint32_t> cell_count_;
+    std::vector<uint32_t> sorted_objects_;
+    std::vector<uint32_t> object_cells_;
+
+    // The grid is built by every thread at once, each over a slice of the slots, and these
+    // hold what each slice found per cell: a row of cells per thread, so their size grows with
+    // the threads as well as with the grid. Chains keep the first and last object of a slice's
+    // piece of every chain; the sorted index keeps how many objects a slice has in a cell,
+    // then where it writes them; both are left empty once the build is done. thread_totals_
+    // is a slot per thread for the prefix sum.
+    std::vector<uint32_t> thread_cell_heads_;
+    std::vector<uint32_t> thread_cell_tails_;
+    std::vector<uint32_t> thread_cell_offsets_;
+    std::vector<uint32_t> thread_totals_;
+
+    // The grid build also counts the objects of every tile, a row of tiles per thread like the
+    // cells, and each slice lists the tiles it was first to find objects in. The rows are left
+    // all empty after every build, so that the next one need not clear them: a world may be
+    // far larger than the part of it that holds objects, and nothing done per frame should
+    // grow with the world.
+    Vec2<size_t> tiles_size_;
+    std::vector<uint32_t> thread_tile_objects_;
+    std::vector<std::vector<uint32_t>> thread_found_tiles_;
+
+    // The objects each slice of an incremental build found out of the cell they are chained
+    // in, with the cell they are in now. binned_ahead_ tells the build that the integration
+    // has found them already, along with the tile counts, and that the objects too big for a
+    // cell are the ones the last sweep set aside.
+    std::vector<std::vector<std::tuple<uint32_t, uint32_t>>> thread_moved_objects_;
+    bool fused_binning_ = false;
+    bool binned_ahead_ = false;
+
+    // The objects too big for a cell: those each slice found, and all of them as the key of
+    // their level and cell and their index, sorted. coarse_moves_ is, for each of them, the
+    // squared length of its move in the last substep.
+    std::vector<std::vector<uint32_t>> thread_coarse_objects_;
+    std::vector<std::tuple<uint64_t, uint32_t>> coarse_objects_;
+    std::vector<float> coarse_moves_;
+
+    // Per thread, the squared length of the furthest move of an object it integrated in the
+    // last substep, for adaptive substeps to find the furthest of all.
+    std::vector<float> thread_max_moves_;
+
+    // The tiles with objects, in index order, and those of the build before. The cells of any
+    // other tile are empty in both layouts, and those of these are empty in the layout not in
+    // use, so only these are built and walked.
+    std::vector<uint32_t> occupied_tiles_;
+    std::vector<uint32_t> previous_occupied_tiles_;
+
+    // The awake tiles of each color, and for each of them the work of the tiles up to it on
+    // the list.
+    std::array<std::vector<uint32_t>, kCollisionTileColors> color_tiles_;
+    std::array<std::vector<uint64_t>, kCollisionTileColors> color_tile_work_ends_;
+
+    // Per tile: the objects it had at the last grid build, the squared length of the furthest
+    // move one of them made in the last substep, and how many quiet substeps it has had in a
+    // row, which stops counting at SubStepsToSleep().
+    bool sleeping_enabled_ = false;
+    std::vector<uint32_t> tile_objects_;
+    std::vector<float> tile_moves_;
+    std::vector<uint32_t> tile_quiet_substeps_;
+
+    std::unique_ptr<TaskScheduler> task_scheduler_;
+    bool thread_pinning_ = false;
+    bool numa_placement_ = false;
+    SubStepExecutor substep_executor_;
+    bool persistent_workers_ = false;
+
+    // Links, in the order they were made. Two links that share no object can be solved at
+    // once, so they are split into colors, none of which has two links on one object, and
+    // every thread solves a share of a color. color_links_ holds them color after color, in
+    // their order within a color, and color_link_ends_ where each color ends. Every object
+    // has a row of object_links_, from link_offsets_, listing the links it is on, dead ones
+    // included, so that deleting it finds its links without going through all of them.
+    // Making links or moving objects in the pool outdates the rows, which are then rebuilt
+    // before they are next needed; deleting only outdates the colors, which are rebuilt
+    // before the next solve. color_link_lambdas_ holds, along color_links_, what each link
+    // has pushed so far in the substep under LinkModel::Xpbd.
+    std::vector<VerletLink> links_;
+    std::vector<VerletLink> color_links_;
+    std::vector<float> color_link_lambdas_;
+    std::vector<uint32_t> color_link_ends_;
+    std::vector<uint32_t> link_offsets_;
+    std::vector<uint32_t> object_links_;
+    bool link_rows_outdated_ = false;
+    bool link_colors_outdated_ = false;
 };
 
 }  // namespace verlet
@@ -35,14 +35,15 @@ void SpawnRandomObjects(VerletSolver& solver, const RandomObjectsParams& params)
 {
     // What UpdatePositions clamps to, less the radius, so a spawned object starts inside the
     // area it will be held in rather than being pulled to the edge on its first step.
-    constexpr float margin = 2.f + VerletObject::GetRadius();
+    const float margin = 2.f + params.radius;
     const auto area = solver.GetSimArea().Enlarged(-margin);
 
-    constexpr float kMaxResolvableSpeed = VerletObject::GetRadius() / VerletSolver::kTimeSubStepDurationSeconds;
-    const float max_speed = std::clamp(params.max_speed, 0.f, kMaxResolvableSpeed);
+    const float max_resolvable_speed = params.radius / solver.GetSubStepSeconds();
+    const float max_speed = std::clamp(params.max_speed, 0.f, max_resolvable_speed);
 
     Random random{params.seed};
-    for ([[maybe_unused]] const size_t index : std::views::iota(size_t{0}, params.count))
+    const auto objects = solver.objects.AllocBatch(params.count);
+    for (const size_t index : std::views::iota(size_t{0}, params.count))
     {
         const Vec2f position{random.Between(area.x.begin, area.x.end), random.Between(area.y.begin, area.y.end)};
 
@@ -50,10 +51,10 @@ void SpawnRandomObjects(VerletSolver& solver, const RandomObjectsParams& params)
         const float speed = random.Between(0.f, max_speed);
         const Vec2f velocity = speed * Vec2f{std::cos(direction), std::sin(direction)};
 
-        auto [id, object] = solver.objects.Alloc();
-        std::ignore = id;
+        const VerletObject& object = std::get<1>(objects[index]);
         object.position = position;
-        object.old_position = position - velocity * VerletSolver::kTimeSubStepDurationSeconds;
+        object.old_position = position - velocity * solver.GetSubStepSeconds();
+        object.radius = params.radius;
         object.movable = params.movable;
 
         const auto rgb = edt::Math::GetRainbowColors(random.UnitInterval());
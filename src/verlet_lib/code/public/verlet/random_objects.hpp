@@ -3,6 +3,8 @@
 #include <cstddef>
 #include <cstdint>
 
+#include "verlet/object.hpp"
+
 namespace verlet
 {
 class VerletSolver;
@@ -21,6 +23,8 @@ public:
     // asks for is capped at what a substep can resolve.
     float max_speed = 10.f;
 
+    float radius = kDefaultObjectRadius;
+
     bool movable = true;
 };
 
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "virtual_memory.hpp"
+
+namespace verlet
+{
+
+// An array whose elements never move. The first time it grows it reserves address space for
+// the most elements it may ever hold, and it commits memory behind that a chunk at a time,
+// so growing never copies what is there and a reference to an element stays good until the
+// array shrinks past it. Chunks are the size of a huge page and start on one, so each can be
+// backed by a single huge page when those are asked for. Only holds elements that can be
+// copied as bytes, which is all the object pool stores.
+template <typename T>
+class StableVector
+{
+    static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>);
+
+public:
+    using value_type = T;
+
+    static constexpr size_t kChunkBytes = size_t{2} << 20;
+
+    explicit StableVector(const size_t max_size) : max_size_{max_size} {}
+
+    StableVector(const StableVector& other) : max_size_{other.max_size_}, huge_pages_{other.huge_pages_}
+    {
+        Commit(other.size_);
+        if (other.size_ != 0) std::memcpy(data_, other.data_, other.size_ * sizeof(T));
+        size_ = other.size_;
+    }
+
+    StableVector(StableVector&& other) noexcept
+        : reservation_{std::exchange(other.reservation_, nullptr)},
+          data_{std::exchange(other.data_, nullptr)},
+          size_{std::exchange(other.size_, 0)},
+          committed_bytes_{std::exchange(other.committed_bytes_, 0)},
+          max_size_{other.max_size_},
+          huge_pages_{other.huge_pages_}
+    {
+    }
+
+    StableVector& operator=(StableVector other) noexcept
+    {
+        std::swap(reservation_, other.reservation_);
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(committed_bytes_, other.committed_bytes_);
+        std::swap(max_size_, other.max_size_);
+        std::swap(huge_pages_, other.huge_pages_);
+        return *this;
+    }
+
+    ~StableVector()
+    {
+        if (reservation_ != nullptr) ReleaseAddressSpace(reservation_, ReservedBytes());
+    }
+
+    [[nodiscard]] T& operator[](const size_t index)
+    {
+        assert(index < size_);
+        return data_[index];
+    }
+
+    [[nodiscard]] const T& operator[](const size_t index) const
+    {
+        assert(index < size_);
+        return data_[index];
+    }
+
+    [[nodiscard]] T* data() { return data_; }                     // NOLINT
+    [[nodiscard]] const T* data() const { return data_; }         // NOLINT
+    [[nodiscard]] T* begin() { return data_; }                    // NOLINT
+    [[nodiscard]] const T* begin() const { return data_; }        // NOLINT
+    [[nodiscard]] T* end() { return data_ + size_; }              // NOLINT
+    [[nodiscard]] const T* end() const { return data_ + size_; }  // NOLINT
+
+    [[nodiscard]] size_t size() const { return size_; }          // NOLINT
+    [[nodiscard]] bool empty() const { return size_ == 0; }      // NOLINT
+    [[nodiscard]] size_t max_size() const { return max_size_; }  // NOLINT
+
+    // New elements are copies of value. Shrinking keeps the memory committed for the next
+    // time the array grows.
+    void resize(const size_t count, const T& value = T{})  // NOLINT
+    {
+        Commit(count);
+        if (count > size_) std::uninitialized_fill(data_ + size_, data_ + count, value);
+        size_ = count;
+    }
+
+    void assign(const size_t count, const T& value)  // NOLINT
+    {
+        Commit(count);
+        std::uninitialized_fill(data_, data_ + count, value);
+        size_ = count;
+    }
+
+    void clear() { size_ = 0; }  // NOLINT
+
+    // Applies to the memory committed so far and to every chunk committed after.
+    void SetHugePagesEnabled(const bool enabled)
+    {
+        huge_pages_ = enabled;
+        if (committed_bytes_ != 0) AdviseHugePages(Bytes(), committed_bytes_, enabled);
+    }
+
+private:
+    [[nodiscard]] static constexpr size_t RoundUpToChunk(const size_t bytes)
+    {
+        return (bytes + kChunkBytes - 1) / kChunkBytes * kChunkBytes;
+    }
+
+    // A chunk more than the elements take, for the start to be moved up to a chunk boundary.
+    [[nodiscard]] size_t ReservedBytes() const { return RoundUpToChunk(max_size_ * sizeof(T)) + kChunkBytes; }
+
+    [[nodiscard]] std::byte* Bytes() const { return reinterpret_cast<std::byte*>(data_); }
+
+    void Commit(const size_t count)
+    {
+        if (count > max_size_) throw std::length_error{"StableVector grown past the most it may hold"};
+
+        const size_t bytes = RoundUpToChunk(count * sizeof(T));
+        if (bytes <= committed_bytes_) return;
+
+        if (reservation_ == nullptr)
+        {
+            reservation_ = ReserveAddressSpace(ReservedBytes());
+            const auto address = reinterpret_cast<uintptr_t>(reservation_);
+            data_ = reinterpret_cast<T*>(RoundUpToChunk(address));
+        }
+
+        CommitAddressSpace(Bytes() + committed_bytes_, bytes - committed_bytes_);
+        if (huge_pages_) AdviseHugePages(Bytes() + committed_bytes_, bytes - committed_bytes_, true);
+        committed_bytes_ = bytes;
+    }
+
+private:
+    std::byte* reservation_ = nullptr;
+    T* data_ = nullptr;
+    size_t size_ = 0;
+    size_t committed_bytes_ = 0;
+    size_t max_size_ = 0;
+    bool huge_pages_ = false;
+};
+
+}  // namespace verlet
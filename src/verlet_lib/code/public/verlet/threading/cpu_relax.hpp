@@ -0,0 +1,17 @@
+#pragma once
+
+namespace verlet
+{
+
+// Tells the core that the thread is spinning on a value another one is about to change, so
+// that it backs off the cache line and leaves its sibling hyperthread the execution units.
+inline void CpuRelax()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+}  // namespace verlet
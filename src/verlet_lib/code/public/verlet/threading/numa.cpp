@@ -0,0 +1,136 @@
+#include "numa.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <tuple>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace verlet
+{
+
+namespace
+{
+
+// Reads a list of the form the kernel writes lists of cores and nodes in, such as "0-3,8,10-11".
+[[nodiscard]] std::vector<uint32_t> ParseList(std::string_view text)
+{
+    std::vector<uint32_t> cpus;
+    while (!text.empty())
+    {
+        const size_t comma = text.find(',');
+        const std::string_view range = text.substr(0, comma);
+        text = comma == std::string_view::npos ? std::string_view{} : text.substr(comma + 1);
+
+        const char* const range_end = range.data() + range.size();
+        uint32_t first = 0;
+        const auto [first_end, error] = std::from_chars(range.data(), range_end, first);
+        if (error != std::errc{}) continue;
+
+        uint32_t last = first;
+        if (first_end != range_end && *first_end == '-') std::ignore = std::from_chars(first_end + 1, range_end, last);
+
+        for (uint32_t cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+    }
+
+    return cpus;
+}
+
+}  // namespace
+
+NumaTopology::NumaTopology()
+{
+#if defined(__linux__)
+    // Node numbers can have gaps, so they are read from the list of the online ones rather
+    // than counted up to the first that is missing.
+    auto read_line = [](const std::string& path)
+    {
+        std::string text;
+        if (std::ifstream file{path}) std::getline(file, text);
+        return text;
+    };
+
+    for (const uint32_t node : ParseList(read_line("/sys/devices/system/node/online")))
+    {
+        auto cpus = ParseList(read_line("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+        if (cpus.empty()) continue;
+
+        node_cpus_.push_back(std::move(cpus));
+        node_ids_.push_back(node);
+    }
+#endif
+
+    if (node_cpus_.empty())
+    {
+        std::vector<uint32_t> cpus(std::max(std::thread::hardware_concurrency(), 1u));
+        std::iota(cpus.begin(), cpus.end(), uint32_t{0});
+        node_cpus_.push_back(std::move(cpus));
+        node_ids_.push_back(0);
+    }
+}
+
+const NumaTopology& NumaTopology::Get()
+{
+    static const NumaTopology topology;
+    return topology;
+}
+
+bool PinThreadToCpu([[maybe_unused]] std::thread::native_handle_type thread, [[maybe_unused]] uint32_t cpu)
+{
+#if defined(__linux__)
+    // The core numbers come from the system's files, and a fixed-size set only has room for so many.
+    if (cpu >= CPU_SETSIZE) return false;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+size_t SystemPageSize()
+{
+#if defined(__linux__)
+    static const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return page_size;
+#else
+    return 4096;
+#endif
+}
+
+size_t MovePages([[maybe_unused]] std::span<void* const> pages, [[maybe_unused]] std::span<const int> nodes)
+{
+#if defined(__linux__) && defined(SYS_move_pages)
+    // Straight to the system call, which is all libnuma's move_pages is. Pages the kernel
+    // cannot move, or that were never touched, come back with an error in their status and
+    // stay where they are, which only costs the placement. A call that fails as a whole, for
+    // a kernel without it or a container that forbids it, moves nothing.
+    constexpr int kMoveOwnPages = 1 << 1;  // MPOL_MF_MOVE
+    std::vector<int> status(pages.size());
+    if (syscall(SYS_move_pages, 0, pages.size(), pages.data(), nodes.data(), status.data(), kMoveOwnPages) < 0)
+    {
+        return 0;
+    }
+
+    size_t placed = 0;
+    for (size_t i = 0; i != pages.size(); ++i)
+    {
+        if (status[i] == nodes[i]) ++placed;
+    }
+    return placed;
+#else
+    return 0;
+#endif
+}
+
+}  // namespace verlet
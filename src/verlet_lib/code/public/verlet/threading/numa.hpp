@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <thread>
+#include <vector>
+
+namespace verlet
+{
+
+// The NUMA nodes of the machine that have cores, and the cores of each, as the kernel lists
+// them. Nodes of memory alone, such as CXL or HBM ones, run no thread, so nothing is placed on
+// them and they are left out. Nodes are counted from zero here whatever the kernel numbers
+// them, NodeId giving the kernel's number. A system that does not say is one node holding
+// every core.
+class NumaTopology
+{
+public:
+    [[nodiscard]] static const NumaTopology& Get();
+
+    [[nodiscard]] size_t NodesCount() const { return node_cpus_.size(); }
+    [[nodiscard]] std::span<const uint32_t> NodeCpus(size_t node) const { return node_cpus_[node]; }
+    [[nodiscard]] uint32_t NodeId(size_t node) const { return node_ids_[node]; }
+
+private:
+    NumaTopology();
+
+private:
+    std::vector<std::vector<uint32_t>> node_cpus_;
+    std::vector<uint32_t> node_ids_;
+};
+
+// Keeps a thread on one core. Returns whether the system let it.
+bool PinThreadToCpu(std::thread::native_handle_type thread, uint32_t cpu);
+
+[[nodiscard]] size_t SystemPageSize();
+
+// Moves every page to the node of the same index, nodes being the kernel's numbers. Returns
+// how many of the pages are on their node afterwards.
+size_t MovePages(std::span<void* const> pages, std::span<const int> nodes);
+
+// How much of the memory PlacePages was asked to move ended up where it was asked to.
+struct PagePlacement
+{
+    size_t pages = 0;
+    size_t placed_pages = 0;
+};
+
+// Asks the kernel to move the pages under memory to the nodes node_of(offset) names, offset
+// being where in memory the page's first byte is, or where memory starts for the page it
+// starts in. A page node_of names no node for stays where it is, as do all of them on a
+// system of one node, or one that cannot move them.
+template <typename NodeOf>
+PagePlacement PlacePages(std::span<const std::byte> memory, NodeOf&& node_of)
+{
+    const NumaTopology& topology = NumaTopology::Get();
+    if (memory.empty() || topology.NodesCount() < 2) return {};
+
+    const size_t page_size = SystemPageSize();
+    const auto begin = reinterpret_cast<uintptr_t>(memory.data());
+    const uintptr_t end = begin + memory.size();
+
+    std::vector<void*> pages;
+    std::vector<int> nodes;
+    for (uintptr_t page = begin & ~(page_size - 1); page < end; page += page_size)
+    {
+        const std::optional<size_t> node = node_of(page < begin ? size_t{0} : page - begin);
+        if (!node) continue;
+
+        pages.push_back(reinterpret_cast<void*>(page));
+        nodes.push_back(static_cast<int>(topology.NodeId(*node)));
+    }
+
+    return {.pages = pages.size(), .placed_pages = MovePages(pages, nodes)};
+}
+
+}  // namespace verlet
@@ -0,0 +1,262 @@
+#include "task_scheduler.hpp"
+
+#include <cassert>
+#include <ranges>
+#include <utility>
+
+#include "verlet/threading/cpu_relax.hpp"
+#include "verlet/threading/numa.hpp"
+
+namespace verlet
+{
+
+namespace
+{
+
+// How many times a thread out of work looks for more before it goes to sleep.
+constexpr size_t kSpinsBeforeSleeping = 1024;
+
+// Which pool the calling thread belongs to, and its index there.
+thread_local const TaskScheduler* t_scheduler = nullptr;
+thread_local size_t t_thread_index = 0;
+
+}  // namespace
+
+TaskScheduler::TaskScheduler(size_t threads_count, bool pin_threads) : pinned_{pin_threads}
+{
+    threads_count = std::max(threads_count, size_t{1});
+    queues_.reserve(threads_count);
+    for ([[maybe_unused]] const size_t thread_index : std::views::iota(size_t{0}, threads_count))
+    {
+        queues_.push_back(std::make_unique<Queue>());
+    }
+
+    const NumaTopology& topology = NumaTopology::Get();
+    thread_nodes_.resize(threads_count);
+    for (const size_t thread_index : std::views::iota(size_t{0}, threads_count))
+    {
+        thread_nodes_[thread_index] = pin_threads ? thread_index * topology.NodesCount() / threads_count : 0;
+    }
+
+    threads_.reserve(threads_count - 1);
+    for (const size_t thread_index : std::views::iota(size_t{1}, threads_count))
+    {
+        threads_.emplace_back(std::bind_front(&TaskScheduler::Work, this, thread_index));
+        if (!pin_threads) continue;
+
+        // The threads of a node take its cores in turn, leaving the first core of the first
+        // node to the thread waiting on the pool, should it run there.
+        const size_t node = thread_nodes_[thread_index];
+        const size_t nodes_count = topology.NodesCount();
+        const size_t node_first_thread = (node * threads_count + nodes_count - 1) / nodes_count;
+        const std::span cpus = topology.NodeCpus(node);
+        PinThreadToCpu(threads_.back().native_handle(), cpus[(thread_index - node_first_thread) % cpus.size()]);
+    }
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    stopping_.store(true, std::memory_order_relaxed);
+    epoch_.fetch_add(1);
+    epoch_.notify_all();
+    threads_.clear();
+}
+
+size_t TaskScheduler::ThisThreadIndex() const
+{
+    return t_scheduler == this ? t_thread_index : 0;
+}
+
+TaskScheduler::TaskHandle TaskScheduler::Submit(std::function<void()> fn, std::span<const TaskHandle> dependencies)
+{
+    auto task = std::make_shared<Task>();
+    task->scheduler_ = this;
+    task->fn_ = std::move(fn);
+    task->unresolved_.store(dependencies.size() + 1, std::memory_order_relaxed);
+
+    // A dependency done before it could be told about this task counts as resolved here.
+    size_t resolved = 1;
+    for (const TaskHandle& dependency : dependencies)
+    {
+        const std::lock_guard lock{dependency->mutex_};
+        if (dependency->done_)
+        {
+            ++resolved;
+        }
+        else
+        {
+            dependency->successors_.push_back(task);
+        }
+    }
+
+    Resolve(task, resolved);
+    return task;
+}
+
+void TaskScheduler::Resolve(const TaskHandle& task, const size_t count)
+{
+    if (task->unresolved_.fetch_sub(count, std::memory_order_acq_rel) == count) Schedule(task);
+}
+
+void TaskScheduler::Schedule(TaskHandle task)
+{
+    Task* raw = task.get();
+    raw->self_ = std::move(task);
+    Push(
+        ThisThreadIndex(),
+        {.context = raw,
+         .run =
+             [](void* context, size_t, size_t)
+         {
+             auto& task = *static_cast<Task*>(context);
+             task.fn_();
+
+             std::vector<TaskHandle> successors;
+             {
+                 const std::lock_guard lock{task.mutex_};
+                 task.done_ = true;
+                 successors = std::move(task.successors_);
+             }
+
+             const TaskHandle self = std::move(task.self_);
+             for (const TaskHandle& successor : successors)
+             {
+                 task.scheduler_->Resolve(successor, 1);
+             }
+             task.finished_.store(true, std::memory_order_release);
+         }});
+}
+
+void TaskScheduler::Wait(const TaskHandle& task)
+{
+    const size_t thread_index = ThisThreadIndex();
+    while (!task->IsDone())
+    {
+        if (!TryRunOne(thread_index)) CpuRelax();
+    }
+}
+
+void TaskScheduler::WaitUntilZero(const std::atomic<size_t>& counter)
+{
+    const size_t thread_index = ThisThreadIndex();
+    while (counter.load(std::memory_order_acquire) != 0)
+    {
+        if (!TryRunOne(thread_index)) CpuRelax();
+    }
+}
+
+void TaskScheduler::RunPinned(const PinnedJob& job)
+{
+    assert(t_scheduler != this);
+
+    struct Gang
+    {
+        PinnedJob job;
+        size_t threads_count = 0;
+        std::atomic<size_t> pending = 0;
+    };
+
+    Gang gang{.job = job, .threads_count = GetThreadsCount()};
+    gang.pending.store(gang.threads_count - 1, std::memory_order_relaxed);
+    for (const size_t thread_index : std::views::iota(size_t{1}, gang.threads_count))
+    {
+        Queue& queue = *queues_[thread_index];
+        const std::lock_guard lock{queue.mutex};
+        queue.pinned = Job{
+            .context = &gang,
+            .run =
+                [](void* context, size_t thread_index, size_t)
+            {
+                auto& gang = *static_cast<Gang*>(context);
+                gang.job.run(gang.job.context, thread_index, gang.threads_count);
+                gang.pending.fetch_sub(1, std::memory_order_release);
+            },
+            .begin = thread_index};
+    }
+    Wake();
+
+    job.run(job.context, 0, gang.threads_count);
+    WaitUntilZero(gang.pending);
+}
+
+void TaskScheduler::Push(const size_t thread_index, const Job& job)
+{
+    Queue& queue = *queues_[thread_index];
+    {
+        const std::lock_guard lock{queue.mutex};
+        queue.jobs.push_back(job);
+        queue.size.store(queue.jobs.size(), std::memory_order_relaxed);
+    }
+    Wake();
+}
+
+void TaskScheduler::Wake()
+{
+    // Goes with the sleeping thread counting itself before it looks at the epoch: either it
+    // sees this push, or this sees it asleep.
+    epoch_.fetch_add(1);
+    if (sleeping_.load() != 0) epoch_.notify_all();
+}
+
+bool TaskScheduler::TryRunOne(const size_t thread_index)
+{
+    std::optional<Job> job;
+    {
+        Queue& queue = *queues_[thread_index];
+        const std::lock_guard lock{queue.mutex};
+        if (queue.pinned)
+        {
+            job = std::exchange(queue.pinned, std::nullopt);
+        }
+        else if (!queue.jobs.empty())
+        {
+            job = queue.jobs.back();
+            queue.jobs.pop_back();
+            queue.size.store(queue.jobs.size(), std::memory_order_relaxed);
+        }
+    }
+
+    for (size_t offset = 1; !job && offset != queues_.size(); ++offset)
+    {
+        Queue& queue = *queues_[(thread_index + offset) % queues_.size()];
+        if (queue.size.load(std::memory_order_relaxed) == 0) continue;
+
+        const std::lock_guard lock{queue.mutex};
+        if (queue.jobs.empty()) continue;
+        job = queue.jobs.front();
+        queue.jobs.pop_front();
+        queue.size.store(queue.jobs.size(), std::memory_order_relaxed);
+    }
+
+    if (!job) return false;
+    job->run(job->context, job->begin, job->end);
+    return true;
+}
+
+void TaskScheduler::Work(const size_t thread_index)
+{
+    t_scheduler = this;
+    t_thread_index = thread_index;
+
+    while (!stopping_.load(std::memory_order_relaxed))
+    {
+        const uint32_t epoch = epoch_.load();
+        if (TryRunOne(thread_index)) continue;
+
+        size_t spins = 0;
+        while (spins != kSpinsBeforeSleeping && epoch_.load(std::memory_order_relaxed) == epoch)
+        {
+            ++spins;
+            CpuRelax();
+        }
+
+        if (spins == kSpinsBeforeSleeping)
+        {
+            sleeping_.fetch_add(1);
+            epoch_.wait(epoch);
+            sleeping_.fetch_sub(1);
+        }
+    }
+}
+
+}  // namespace verlet
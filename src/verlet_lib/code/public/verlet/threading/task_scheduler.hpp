@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace verlet
+{
+
+// A pool of threads that share out work by stealing it from each other. Every thread keeps a
+// queue of jobs and takes from its back what it pushed last; a thread out of work steals from
+// the front of another's, which is where the biggest halves of a split range wait. A thread
+// waiting on the pool from outside works as thread 0 until what it waits on is done, so the
+// pool starts one thread fewer than it counts and a wait never leaves a core idle.
+//
+// The simulation, the renderer and the app all hand their work to the one pool, so none of
+// them starts threads that fight the others for the cores.
+class TaskScheduler
+{
+public:
+    // A function queued with Submit, which other tasks may wait for.
+    class Task
+    {
+    public:
+        [[nodiscard]] bool IsDone() const { return finished_.load(std::memory_order_acquire); }
+
+    private:
+        friend class TaskScheduler;
+
+        TaskScheduler* scheduler_ = nullptr;
+        std::function<void()> fn_;
+
+        // The dependencies not done yet, and one more while Submit is still registering them.
+        std::atomic<size_t> unresolved_ = 0;
+
+        // The tasks waiting for this one, until it is done.
+        std::mutex mutex_;
+        std::vector<std::shared_ptr<Task>> successors_;
+        bool done_ = false;
+
+        std::atomic<bool> finished_ = false;
+
+        // Keeps the task alive while it is queued and nobody else holds it.
+        std::shared_ptr<Task> self_;
+    };
+
+    using TaskHandle = std::shared_ptr<Task>;
+
+    // Pinned threads are spread over the NUMA nodes in blocks, the first threads on the first
+    // node, and each kept on a core of its node. The thread that waits on the pool is not the
+    // pool's to pin, and counts as one of the first node.
+    explicit TaskScheduler(size_t threads_count, bool pin_threads = false);
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler(TaskScheduler&&) = delete;
+    ~TaskScheduler();
+
+    // Counting the thread that waits on the pool.
+    [[nodiscard]] size_t GetThreadsCount() const { return queues_.size(); }
+
+    [[nodiscard]] bool AreThreadsPinned() const { return pinned_; }
+
+    // The NUMA node a thread is kept on when the threads are pinned. The thread that waits on
+    // the pool is kept nowhere, and its node is only where the others are counted from.
+    [[nodiscard]] size_t GetThreadNode(size_t thread_index) const { return thread_nodes_[thread_index]; }
+
+    // Queues fn to run once all of dependencies have.
+    TaskHandle Submit(std::function<void()> fn, std::span<const TaskHandle> dependencies = {});
+
+    // Runs queued jobs until task is done.
+    void Wait(const TaskHandle& task);
+
+    // Calls fn(first, last) for runs of [begin, end) that together cover it once, and returns
+    // once they all have. A thread splits its run in half for as long as the run is longer
+    // than grain and its queue is empty, so a pool with idle threads has half of someone's
+    // run to steal at any time, and a busy one leaves runs whole.
+    template <typename Fn>
+    void ParallelFor(size_t begin, size_t end, size_t grain, Fn&& fn)
+    {
+        if (begin == end) return;
+
+        using Loop = ForLoop<std::remove_reference_t<Fn>>;
+        Loop loop{.scheduler = this, .fn = &fn, .grain = std::max(grain, size_t{1})};
+        RunRange<Loop>(&loop, begin, end);
+        WaitUntilZero(loop.pending);
+    }
+
+    // Calls fn(slice_index, slices_count) for as many slices as the pool has threads, on
+    // whichever threads get to them first.
+    template <typename Fn>
+    void RunBatch(Fn&& fn)
+    {
+        const size_t slices_count = GetThreadsCount();
+        ParallelFor(
+            0,
+            slices_count,
+            1,
+            [&](const size_t first, const size_t last)
+            {
+                for (size_t slice = first; slice != last; ++slice) fn(slice, slices_count);
+            });
+    }
+
+    // Calls fn(thread_index, threads_count) on every thread of the pool at once, the calling
+    // one as thread 0, for work whose threads wait for each other and so cannot be stolen by
+    // one thread twice. Every other thread gets to it once it is done with what it has in
+    // hand. Only a thread outside the pool may call it.
+    template <typename Fn>
+    void RunOnEveryThread(Fn&& fn)
+    {
+        RunPinned(
+            {.context = &fn,
+             .run = [](void* context, size_t thread_index, size_t threads_count)
+             { (*static_cast<std::remove_reference_t<Fn>*>(context))(thread_index, threads_count); }});
+    }
+
+private:
+    struct Job
+    {
+        void* context = nullptr;
+        void (*run)(void* context, size_t begin, size_t end) = nullptr;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    // Kept a cache line apart, as every thread locks its own all the time.
+    struct alignas(64) Queue
+    {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+        std::atomic<size_t> size = 0;
+
+        // A job of RunOnEveryThread, which only this thread may run.
+        std::optional<Job> pinned;
+    };
+
+    template <typename Fn>
+    struct ForLoop
+    {
+        TaskScheduler* scheduler = nullptr;
+        Fn* fn = nullptr;
+        size_t grain = 1;
+
+        // The runs started and not done yet.
+        std::atomic<size_t> pending = 1;
+    };
+
+    template <typename Loop>
+    static void RunRange(void* context, size_t begin, size_t end)
+    {
+        auto& loop = *static_cast<Loop*>(context);
+        TaskScheduler& scheduler = *loop.scheduler;
+        const size_t thread_index = scheduler.ThisThreadIndex();
+        while (begin != end)
+        {
+            if (end - begin > loop.grain && scheduler.IsQueueEmpty(thread_index))
+            {
+                const size_t middle = begin + (end - begin) / 2;
+                loop.pending.fetch_add(1, std::memory_order_relaxed);
+                scheduler.Push(
+                    thread_index,
+                    {.context = context, .run = &RunRange<Loop>, .begin = middle, .end = end});
+                end = middle;
+                continue;
+            }
+
+            const size_t last = std::min(begin + loop.grain, end);
+            (*loop.fn)(begin, last);
+            begin = last;
+        }
+
+        loop.pending.fetch_sub(1, std::memory_order_release);
+    }
+
+    struct PinnedJob
+    {
+        void* context = nullptr;
+        void (*run)(void* context, size_t thread_index, size_t threads_count) = nullptr;
+    };
+
+    void RunPinned(const PinnedJob& job);
+
+    // The index of the calling thread in this pool; any thread not of the pool is thread 0.
+    [[nodiscard]] size_t ThisThreadIndex() const;
+
+    [[nodiscard]] bool IsQueueEmpty(size_t thread_index) const
+    {
+        return queues_[thread_index]->size.load(std::memory_order_relaxed) == 0;
+    }
+
+    void Push(size_t thread_index, const Job& job);
+    void Schedule(TaskHandle task);
+
+    // Takes one dependency off the task and queues it if that was the last one.
+    void Resolve(const TaskHandle& task, size_t count);
+
+    // Runs a job: the thread's pinned one first, then its own newest one, then the oldest one
+    // of another thread. Returns whether there was any.
+    bool TryRunOne(size_t thread_index);
+
+    // Runs jobs until counter drops to zero.
+    void WaitUntilZero(const std::atomic<size_t>& counter);
+
+    void Work(size_t thread_index);
+
+    // Wakes the threads sleeping for want of jobs.
+    void Wake();
+
+private:
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::jthread> threads_;
+    std::vector<size_t> thread_nodes_;
+    bool pinned_ = false;
+
+    // Bumped by every push, so that a thread going to sleep can tell whether one came in
+    // since it last looked.
+    std::atomic<uint32_t> epoch_ = 0;
+    std::atomic<uint32_t> sleeping_ = 0;
+    std::atomic<bool> stopping_ = false;
+};
+
+}  // namespace verlet
@@ -23,7 +23,7 @@ void DeleteObjectsTool::Tick()
             {
                 for (auto object_id : app_.solver.ForEachObjectInCell(app_.solver.CellToCellIndex({cell_x, cell_y})))
                 {
-                    auto& object = app_.solver.objects.Get(object_id);
+                    const auto object = app_.solver.objects.Get(object_id);
                     if ((object.position - mouse_pos).SquaredLength() < rsq)
                     {
                         app_.solver.DeleteObject(object_id);
@@ -31,6 +31,15 @@ void DeleteObjectsTool::Tick()
                 }
             }
         }
+
+        for (auto object_id : app_.solver.ForEachCoarseObject())
+        {
+            const auto object = app_.solver.objects.Get(object_id);
+            if ((object.position - mouse_pos).SquaredLength() < rsq)
+            {
+                app_.solver.DeleteObject(object_id);
+            }
+        }
     }
 }
 
@@ -25,7 +25,7 @@ void MoveObjectsTool::Tick()
         {
             if (auto id = FindObject(get_mouse_pos()); id.IsValid())
             {
-                auto& object = app_.solver.objects.Get(id);
+                auto object = app_.solver.objects.Get(id);
                 held_object_ = {.index = id, .was_movable = object.movable};
                 object.movable = false;
             }
@@ -38,8 +38,17 @@ void MoveObjectsTool::Tick()
 
     if (held_object_)
     {
-        auto& object = app_.solver.objects.Get(held_object_->index);
-        object.position = get_mouse_pos();
+        // Something else may have deleted the held object, and then there is nothing to hold.
+        if (const auto object = app_.solver.objects.TryGet(held_object_->index))
+        {
+            app_.solver.WakeArea(object->position, 2 * object->GetRadius());
+            object->position = get_mouse_pos();
+            app_.solver.WakeArea(object->position, 2 * object->GetRadius());
+        }
+        else
+        {
+            held_object_ = std::nullopt;
+        }
     }
 }
 
@@ -48,17 +57,24 @@ void MoveObjectsTool::DrawGUI()
     ImGui::Text("Click and hold with left mouse button on object to move it");  // NOLINT
 }
 
+void MoveObjectsTool::RemapObjects(const ObjectIdRemap& remap)
+{
+    if (held_object_) held_object_->index = remap(held_object_->index);
+}
+
 void MoveObjectsTool::ReleaseObject(const Vec2f& mouse_position)
 {
     lmb_hold = false;
-    if (held_object_)
+    if (!held_object_) return;
+
+    if (const auto object = app_.solver.objects.TryGet(held_object_->index))
     {
-        auto& object = app_.solver.objects.Get(held_object_->index);
-        object.position = mouse_position;
-        object.old_position = object.position;
-        object.movable = held_object_->was_movable;
-        held_object_ = std::nullopt;
+        object->position = mouse_position;
+        object->old_position = object->position;
+        object->movable = held_object_->was_movable;
+        app_.solver.WakeArea(object->position, 2 * object->GetRadius());
     }
+    held_object_ = std::nullopt;
 }
 
 ObjectId MoveObjectsTool::FindObject(const Vec2f& mouse_position) const
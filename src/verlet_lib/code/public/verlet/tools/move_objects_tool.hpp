@@ -21,6 +21,7 @@ public:
     ~MoveObjectsTool() override;
     void Tick() override;
     void DrawGUI() override;
+    void RemapObjects(const ObjectIdRemap& remap) override;
     [[nodiscard]] ToolType GetToolType() const override { return ToolType::MoveObjects; }
 
 private:
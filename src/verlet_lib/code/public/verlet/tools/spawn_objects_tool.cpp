@@ -15,6 +15,10 @@ void SpawnObjectsTool::Tick()
 
         auto rgb = edt::Math::GetRainbowColors(app_.GetTimeSeconds());
 
+        // Looked up before allocating: the object spawned before may have been deleted since,
+        // and the new object could take its slot.
+        const auto previous_object = app_.solver.objects.TryGet(previous_spawned_);
+
         auto [spawned_object_id, new_object] = app_.solver.objects.Alloc();
         new_object.position = mouse_position;
         new_object.old_position = mouse_position;
@@ -24,18 +28,16 @@ void SpawnObjectsTool::Tick()
         new_object.color.w() = 255;
         new_object.movable = spawn_movable_objects_;
 
-        if (link_spawned_to_previous_ && previous_spawned_.IsValid())
+        if (link_spawned_to_previous_ && previous_object)
         {
-            auto& previous_object = app_.solver.objects.Get(previous_spawned_);
-
-            const float target_distance = previous_object.GetRadius() + new_object.GetRadius();
+            const float target_distance = previous_object->GetRadius() + new_object.GetRadius();
             app_.solver.CreateLink(spawned_object_id, previous_spawned_, target_distance);
 
             // if spawned object is movable spawn it nearby the object it links to
             if (new_object.movable)
             {
-                auto dir = (new_object.position - previous_object.position).Normalized();
-                new_object.position = previous_object.position + dir * target_distance * 1.001f;
+                auto dir = (new_object.position - previous_object->position).Normalized();
+                new_object.position = previous_object->position + dir * target_distance * 1.001f;
                 new_object.old_position = new_object.position;
             }
 
@@ -49,6 +51,11 @@ void SpawnObjectsTool::Tick()
     }
 }
 
+void SpawnObjectsTool::RemapObjects(const ObjectIdRemap& remap)
+{
+    previous_spawned_ = remap(previous_spawned_);
+}
+
 void SpawnObjectsTool::DrawGUI()
 {
     ImGui::Text("Use left mouse button to spawn objects");  // NOLINT
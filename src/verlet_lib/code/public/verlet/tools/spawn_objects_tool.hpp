@@ -9,6 +9,7 @@ public:
     using Tool::Tool;
     void Tick() override;
     void DrawGUI() override;
+    void RemapObjects(const ObjectIdRemap& remap) override;
     [[nodiscard]] ToolType GetToolType() const override { return ToolType::SpawnObjects; }
 
 private:
@@ -5,6 +5,7 @@
 namespace verlet
 {
 class VerletApp;
+class ObjectIdRemap;
 
 enum class ToolType : u8
 {
@@ -22,6 +23,9 @@ public:
     virtual void Tick() {}
     virtual void DrawInWorld() {}
     virtual void DrawGUI() {}
+
+    // The solver moved its objects around; any id the tool holds has to be looked up again.
+    virtual void RemapObjects([[maybe_unused]] const ObjectIdRemap& remap) {}
     [[nodiscard]] virtual ToolType GetToolType() const = 0;
 
 protected:
@@ -19,6 +19,7 @@
 #include "tools/spawn_objects_tool.hpp"
 #include "verlet/json/json_helpers.hpp"
 #include "verlet/json/json_keys.hpp"
+#include "verlet/threading/task_scheduler.hpp"
 
 namespace verlet
 {
@@ -127,7 +128,7 @@ size_t VerletApp::ObjectsCapacity() const
 {
     // Circles of one radius pack in a hexagonal lattice at best, where each takes
     // up a rhombus of this area.
-    const float per_object = 2 * std::numbers::sqrt3_v<float> * edt::Math::Sqr(VerletObject::GetRadius());
+    const float per_object = 2 * std::numbers::sqrt3_v<float> * edt::Math::Sqr(kDefaultObjectRadius);
     const auto area = solver.GetSimArea().Extent();
     return static_cast<size_t>((area.x() * area.y()) / per_object);
 }
@@ -188,6 +189,12 @@ void VerletApp::UpdateSimulation()
 
     perf_stats_.sim_update = solver.Update();
     time_steps_++;
+
+    if (objects_reorder_period_ != 0 && time_steps_ % objects_reorder_period_ == 0)
+    {
+        const auto remap = solver.ReorderObjects();
+        if (tool_) tool_->RemapObjects(remap);
+    }
 }
 
 void VerletApp::Render()
@@ -265,7 +272,13 @@ void VerletApp::LoadAppState(const std::filesystem::path& path)
                 max_objects_count_ = json[JSONKeys::kMaxObjectsCount];
             }
 
+            // Presets from before the solver could be configured simulate the way they always did.
+            const SolverConfig solver_config = json.contains(JSONKeys::kSolver)
+                                                   ? JSONHelpers::SolverConfigFromJSON(json[JSONKeys::kSolver])
+                                                   : SolverConfig{};
+
             GetWindow().SetSize(window_size.x(), window_size.y());
+            solver.SetConfig(solver_config);
 
             DeleteAllEmitters();
 
@@ -298,7 +311,7 @@ void VerletApp::SavePositions(const std::filesystem::path& path) const
 
 void VerletApp::RenderWorld()
 {
-    ObjectColorFunction color_function = [](const VerletObject& object)
+    ObjectColorFunction color_function = [](const ConstVerletObject object)
     {
         return object.color;
     };
@@ -306,10 +319,18 @@ void VerletApp::RenderWorld()
 
     instance_painter_.Clear();
 
-    auto paint_instanced_object = [&](const VerletObject& object) mutable
+    // The colors are worked out on the solver's pool, a slot per object, which is why a tick
+    // color function has to be safe to call from several threads. Only handing the instances
+    // to the painter, which takes them one at a time, is left to this thread.
+    constexpr size_t kColorGrain = 4096;
+    auto color_objects = [&](const size_t first, const size_t last)
     {
-        const auto& color = color_function(object);
-        instance_painter_.DrawObject(object.position, color, object.GetRadius() + Vec2f{});
+        const std::span flags = solver.objects.Flags();
+        for (const size_t index : std::views::iota(first, last))
+        {
+            if (!flags[index].alive) continue;
+            instance_colors_[index] = color_function(solver.objects.ObjectAt(index));
+        }
     };
 
     perf_stats_.render.total = edt::MeasureTime(
@@ -318,9 +339,15 @@ void VerletApp::RenderWorld()
             perf_stats_.render.set_circle_loop = edt::MeasureTime(
                 [&]
                 {
-                    for (const VerletObject& object : solver.objects.Objects())
+                    instance_colors_.resize(solver.objects.SlotsCount());
+                    solver.GetTaskScheduler().ParallelFor(0, instance_colors_.size(), kColorGrain, color_objects);
+                    for (const size_t index : solver.objects.LiveSlots())
                     {
-                        paint_instanced_object(object);
+                        const auto object = solver.objects.ObjectAt(index);
+                        instance_painter_.DrawObject(
+                            object.position,
+                            instance_colors_[index],
+                            object.GetRadius() + Vec2f{});
                     }
                 });
 
@@ -128,6 +128,11 @@ public:
     // count above, and a preset carrying it survives a change of resolution.
     std::optional<float> max_objects_saturation_;
     size_t time_steps_ = 0;
+
+    // Every this many steps the solver stores its objects in the order they lie in the world.
+    // Zero never does, which keeps objects in spawn order for as long as they live.
+    size_t objects_reorder_period_ = 0;
+
     bool paused_ = false;
     bool step_requested_ = false;
 
@@ -149,6 +154,9 @@ private:
 
     Camera camera_{};
     InstancedPainter instance_painter_{};
+
+    // Per slot of the pool, the color the object is drawn in this frame.
+    std::vector<Vec4<uint8_t>> instance_colors_{};
     std::vector<std::unique_ptr<Emitter>> emitters_{};
     PerfStats perf_stats_{};
     Vec3f background_color_{};
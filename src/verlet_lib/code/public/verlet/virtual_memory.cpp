@@ -0,0 +1,56 @@
+#include "virtual_memory.hpp"
+
+#include <new>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace verlet
+{
+
+std::byte* ReserveAddressSpace(const size_t bytes)
+{
+#if defined(_WIN32)
+    void* const memory = VirtualAlloc(nullptr, bytes, MEM_RESERVE, PAGE_NOACCESS);
+    if (memory == nullptr) throw std::bad_alloc{};
+#else
+    // Inaccessible and not counted against the commit limit, so a reservation far larger
+    // than the machine's memory costs nothing but address space.
+    void* const memory = mmap(nullptr, bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (memory == MAP_FAILED) throw std::bad_alloc{};
+#endif
+    return static_cast<std::byte*>(memory);
+}
+
+void CommitAddressSpace(std::byte* const begin, const size_t bytes)
+{
+#if defined(_WIN32)
+    if (VirtualAlloc(begin, bytes, MEM_COMMIT, PAGE_READWRITE) == nullptr) throw std::bad_alloc{};
+#else
+    if (mprotect(begin, bytes, PROT_READ | PROT_WRITE) != 0) throw std::bad_alloc{};
+#endif
+}
+
+void ReleaseAddressSpace(std::byte* const begin, [[maybe_unused]] const size_t bytes)
+{
+#if defined(_WIN32)
+    VirtualFree(begin, 0, MEM_RELEASE);
+#else
+    munmap(begin, bytes);
+#endif
+}
+
+bool AdviseHugePages([[maybe_unused]] std::byte* const begin, [[maybe_unused]] const size_t bytes, const bool enabled)
+{
+#if defined(MADV_HUGEPAGE)
+    return madvise(begin, bytes, enabled ? MADV_HUGEPAGE : MADV_NOHUGEPAGE) == 0;
+#else
+    return !enabled;
+#endif
+}
+
+}  // namespace verlet
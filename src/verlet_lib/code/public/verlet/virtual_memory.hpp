@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+
+namespace verlet
+{
+
+// Sets aside address space that nothing else will be given, without any memory behind it
+// yet. Throws std::bad_alloc if the system has no room left for it.
+[[nodiscard]] std::byte* ReserveAddressSpace(size_t bytes);
+
+// Backs part of a reservation with memory, which reads as zeroes until written. Throws
+// std::bad_alloc if the system will not commit that much.
+void CommitAddressSpace(std::byte* begin, size_t bytes);
+
+// Gives a whole reservation back, along with whatever memory was committed in it.
+void ReleaseAddressSpace(std::byte* begin, size_t bytes);
+
+// Asks for committed memory to be backed by transparent huge pages, or not to be. Returns
+// whether the system took the advice; one without huge pages ignores it.
+bool AdviseHugePages(std::byte* begin, size_t bytes, bool enabled);
+
+}  // namespace verlet
@@ -0,0 +1,204 @@
+#include "verlet/physics/collision_kernels.hpp"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "magic_enum/magic_enum.hpp"
+#include "verlet/physics/verlet_solver.hpp"
+
+namespace
+{
+std::vector<verlet::CollisionKernel> SupportedKernels()
+{
+    std::vector<verlet::CollisionKernel> kernels;
+    for (const auto kernel : magic_enum::enum_values<verlet::CollisionKernel>())
+    {
+        if (verlet::CollisionKernels::IsSupported(kernel)) kernels.push_back(kernel);
+    }
+    return kernels;
+}
+
+std::vector<edt::Vec2f> Simulate(
+    verlet::CollisionKernel kernel,
+    verlet::Broadphase broadphase,
+    verlet::CollisionStencil stencil,
+    size_t steps)
+{
+    verlet::VerletSolver solver;
+    solver.SetCollisionKernel(kernel);
+    solver.SetBroadphase(broadphase);
+    solver.SetCollisionStencil(stencil);
+
+    const auto origin = solver.GetSimArea().Min() + 10.f;
+    for (size_t y = 0; y != 40; ++y)
+    {
+        for (size_t x = 0; x != 40; ++x)
+        {
+            auto [id, object] = solver.objects.Alloc();
+            std::ignore = id;
+            object.position = origin + edt::Vec2f{static_cast<float>(x), static_cast<float>(y)} * 0.8f;
+            object.old_position = object.position;
+            object.movable = (x + y) % 11 != 0;
+
+            // A few objects are smaller than the rest and a few are too big for a cell.
+            if ((x + 2 * y) % 5 == 0) object.radius = 0.35f;
+            if (x % 13 == 6 && y % 13 == 6) object.radius = 1.5f;
+        }
+    }
+
+    for (size_t step = 0; step != steps; ++step) std::ignore = solver.Update();
+
+    std::vector<edt::Vec2f> positions;
+    for (const auto& object : solver.objects.Objects()) positions.push_back(object.position);
+    return positions;
+}
+
+// Kernels are documented to agree to the bit, so there is no tolerance to allow for.
+void ExpectSamePositions(const std::vector<edt::Vec2f>& expected, const std::vector<edt::Vec2f>& actual)
+{
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t i = 0; i != expected.size(); ++i)
+    {
+        EXPECT_EQ(expected[i].x(), actual[i].x()) << "object " << i;
+        EXPECT_EQ(expected[i].y(), actual[i].y()) << "object " << i;
+    }
+}
+}  // namespace
+
+TEST(CollisionKernelsTest, ScalarIsAlwaysSupported)  // NOLINT
+{
+    EXPECT_TRUE(verlet::CollisionKernels::IsSupported(verlet::CollisionKernel::Scalar));
+    EXPECT_TRUE(verlet::CollisionKernels::IsSupported(verlet::CollisionKernels::Preferred()));
+}
+
+// A crowd piled up around a few objects, most pairs touching. The list is longer than a batch
+// and not a multiple of one, the objects are listed among the others, and one of them is
+// fixed, so a vectorized kernel sees batches where the object never moves as well as batches
+// where it moves far enough to have to start over. The objects are of all sizes, one of them
+// far bigger than the rest.
+TEST(CollisionKernelsTest, KernelsMatchOnACrowd)  // NOLINT
+{
+    std::vector<edt::Vec2f> initial_positions;
+    std::vector<float> radii;
+    std::vector<verlet::ObjectFlags> flags;
+    for (size_t i = 0; i != 21; ++i)
+    {
+        const float angle = static_cast<float>(i) * 0.7f;
+        const float distance = 0.05f * static_cast<float>(i);
+        initial_positions.push_back(edt::Vec2f{std::cos(angle), std::sin(angle)} * distance);
+        radii.push_back(i == 11 ? 2.f : 0.3f + 0.01f * static_cast<float>(i));
+        flags.push_back({.movable = i != 4, .alive = true});
+    }
+
+    auto solve = [&](const verlet::CollisionKernel kernel, const verlet::CollisionStencil stencil)
+    {
+        verlet::CollisionNeighbours neighbours;
+        for (size_t i = 0; i != initial_positions.size(); ++i)
+        {
+            neighbours.Add(static_cast<uint32_t>(i), initial_positions[i], radii[i], flags[i]);
+        }
+
+        verlet::CollisionKernels::Get(kernel)(neighbours, 3, 4, stencil);
+
+        auto positions = initial_positions;
+        neighbours.WriteBack(positions);
+        return positions;
+    };
+
+    for (const auto stencil : magic_enum::enum_values<verlet::CollisionStencil>())
+    {
+        SCOPED_TRACE(magic_enum::enum_name(stencil));
+        const auto expected = solve(verlet::CollisionKernel::Scalar, stencil);
+        ASSERT_NE(expected[3].x(), initial_positions[3].x());
+
+        for (const auto kernel : SupportedKernels())
+        {
+            SCOPED_TRACE(magic_enum::enum_name(kernel));
+            ExpectSamePositions(expected, solve(kernel, stencil));
+        }
+    }
+}
+
+// With the half stencil an object is only measured against the ones after it, so the last one
+// on the list moves only when an earlier one is pushed away from it.
+TEST(CollisionKernelsTest, HalfStencilSolvesEachPairOnce)  // NOLINT
+{
+    auto solve = [&](const verlet::CollisionStencil stencil)
+    {
+        verlet::CollisionNeighbours neighbours;
+        neighbours.Add(0, edt::Vec2f{0.f, 0.f}, 0.5f, {.movable = true, .alive = true});
+        neighbours.Add(1, edt::Vec2f{0.5f, 0.f}, 0.5f, {.movable = true, .alive = true});
+        verlet::CollisionKernels::Get(verlet::CollisionKernel::Scalar)(neighbours, 0, 2, stencil);
+
+        std::vector<edt::Vec2f> positions(2);
+        neighbours.WriteBack(positions);
+        return positions[1].x() - positions[0].x();
+    };
+
+    // Each solve closes half of the overlap: once for the half stencil, twice for the full one.
+    EXPECT_FLOAT_EQ(solve(verlet::CollisionStencil::Half), 0.75f);
+    EXPECT_FLOAT_EQ(solve(verlet::CollisionStencil::Full), 0.875f);
+}
+
+// Two objects of different sizes touch at the sum of their radii, and the small one takes the
+// bigger share of the push, as much bigger as the other object is.
+TEST(CollisionKernelsTest, BiggerObjectIsPushedLess)  // NOLINT
+{
+    for (const auto kernel : SupportedKernels())
+    {
+        SCOPED_TRACE(magic_enum::enum_name(kernel));
+        verlet::CollisionNeighbours neighbours;
+        neighbours.Add(0, edt::Vec2f{0.f, 0.f}, 0.25f, {.movable = true, .alive = true});
+        neighbours.Add(1, edt::Vec2f{0.5f, 0.f}, 0.75f, {.movable = true, .alive = true});
+        verlet::CollisionKernels::Get(kernel)(neighbours, 0, 1, verlet::CollisionStencil::Half);
+
+        std::vector<edt::Vec2f> positions(2);
+        neighbours.WriteBack(positions);
+
+        // Half of the overlap of 0.5 is closed, three quarters of it by the small object.
+        EXPECT_FLOAT_EQ(positions[0].x(), -0.1875f);
+        EXPECT_FLOAT_EQ(positions[1].x(), 0.5625f);
+    }
+}
+
+// A Jacobi pass moves nothing while it measures: each of two overlapping objects is asked to
+// move its share of half the overlap, as measured from where both of them were.
+TEST(CollisionKernelsTest, JacobiSumsCorrectionsWithoutMoving)  // NOLINT
+{
+    verlet::CollisionNeighbours neighbours;
+    neighbours.Add(0, edt::Vec2f{0.f, 0.f}, 0.5f, {.movable = true, .alive = true});
+    neighbours.Add(1, edt::Vec2f{0.5f, 0.f}, 0.5f, {.movable = true, .alive = true});
+    neighbours.Add(2, edt::Vec2f{0.5f, 0.6f}, 0.25f, {.movable = false, .alive = true});
+
+    std::vector<edt::Vec2f> displacements(3);
+    verlet::CollisionKernels::AccumulateCorrections(neighbours, 0, 2, displacements);
+
+    std::vector<edt::Vec2f> positions(3);
+    neighbours.WriteBack(positions);
+    EXPECT_EQ(positions[1], edt::Vec2f(0.5f, 0.f));
+
+    // Object 1 also overlaps the fixed object 2, by 0.15, and takes all of that pair's half.
+    EXPECT_FLOAT_EQ(displacements[0].x(), -0.125f);
+    EXPECT_FLOAT_EQ(displacements[0].y(), 0.f);
+    EXPECT_FLOAT_EQ(displacements[1].x(), 0.125f);
+    EXPECT_FLOAT_EQ(displacements[1].y(), -0.075f);
+    EXPECT_EQ(displacements[2], edt::Vec2f{});
+}
+
+TEST(CollisionKernelsTest, KernelsMatchOverASimulation)  // NOLINT
+{
+    for (const auto broadphase : magic_enum::enum_values<verlet::Broadphase>())
+    {
+        SCOPED_TRACE(magic_enum::enum_name(broadphase));
+        for (const auto stencil : magic_enum::enum_values<verlet::CollisionStencil>())
+        {
+            SCOPED_TRACE(magic_enum::enum_name(stencil));
+            const auto expected = Simulate(verlet::CollisionKernel::Scalar, broadphase, stencil, 50);
+            for (const auto kernel : SupportedKernels())
+            {
+                SCOPED_TRACE(magic_enum::enum_name(kernel));
+                ExpectSamePositions(expected, Simulate(kernel, broadphase, stencil, 50));
+            }
+        }
+    }
+}
@@ -1,5 +1,7 @@
 #include "verlet/object_pool.hpp"
 
+#include <algorithm>
+#include <tuple>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -81,6 +83,72 @@ TEST(ObjectPoolTest, ReusesAFreedSlot)  // NOLINT
     EXPECT_EQ(pool.ObjectsCount(), 1U);
 }
 
+// Spawning in one batch must not change which objects come out, or a replayed simulation
+// that spawned them one at a time the first time would diverge.
+TEST(ObjectPoolTest, AllocBatchMatchesAllocInALoop)  // NOLINT
+{
+    for (const bool dense : {false, true})
+    {
+        verlet::ObjectPool one_by_one;
+        verlet::ObjectPool batched;
+        one_by_one.SetDenseEnabled(dense);
+        batched.SetDenseEnabled(dense);
+        for (verlet::ObjectPool* pool : {&one_by_one, &batched})
+        {
+            std::vector<verlet::ObjectId> ids;
+            for (size_t i = 0; i != 5; ++i) ids.push_back(std::get<0>(pool->Alloc()));
+            pool->Free(ids[3]);
+            pool->Free(ids[1]);
+        }
+
+        std::vector<verlet::ObjectId> expected;
+        for (size_t i = 0; i != 4; ++i) expected.push_back(std::get<0>(one_by_one.Alloc()));
+
+        const auto objects = batched.AllocBatch(4);
+        ASSERT_EQ(objects.size(), 4U);
+        for (size_t i = 0; i != objects.size(); ++i)
+        {
+            const auto& [id, object] = objects[i];
+            EXPECT_EQ(id, expected[i]);
+            object.position = {static_cast<float>(i), 0.f};
+        }
+
+        EXPECT_EQ(batched.ObjectsCount(), 7U);
+        EXPECT_EQ(Identifiers(batched), Identifiers(one_by_one));
+        for (size_t i = 0; i != expected.size(); ++i)
+        {
+            EXPECT_EQ(batched.Get(expected[i]).position.x(), static_cast<float>(i));
+        }
+    }
+}
+
+// Whoever holds an object across a spawn, like an emitter filling a batch or a tool dragging
+// an object, has to find it where it was however far the pool grew in between.
+TEST(ObjectPoolTest, ObjectsStayPutAsThePoolGrows)  // NOLINT
+{
+    for (const bool huge_pages : {false, true})
+    {
+        verlet::ObjectPool pool;
+        pool.SetHugePagesEnabled(huge_pages);
+        const auto [id, object] = pool.Alloc();
+        object.position = {1.f, 2.f};
+        const verlet::Vec2f* const position = &object.position;
+
+        // Past a few chunks of every array, positions being the largest.
+        const size_t count = 4 * verlet::StableVector<verlet::Vec2f>::kChunkBytes / sizeof(verlet::Vec2f);
+        [[maybe_unused]] const auto batch = pool.AllocBatch(count);
+        for (size_t i = 0; i != 1000; ++i)
+        {
+            [[maybe_unused]] const auto entry = pool.Alloc();
+        }
+
+        EXPECT_EQ(&pool.Get(id).position, position);
+        EXPECT_EQ(pool.Get(id).position.y(), 2.f);
+        EXPECT_EQ(pool.Positions().data(), position);
+        EXPECT_EQ(pool.ObjectsCount(), count + 1001);
+    }
+}
+
 TEST(ObjectPoolTest, ClearRemovesEverything)  // NOLINT
 {
     verlet::ObjectPool pool;
@@ -128,3 +196,152 @@ TEST(ObjectPoolTest, ClearsAPoolWithHoles)  // NOLINT
     EXPECT_EQ(pool.ObjectsCount(), 0U);
     EXPECT_TRUE(Identifiers(pool).empty());
 }
+
+// The solver reads the arrays rather than the objects, so both have to be the same storage.
+TEST(ObjectPoolTest, ArraysHoldWhatWasWrittenThroughTheObject)  // NOLINT
+{
+    verlet::ObjectPool pool;
+    [[maybe_unused]] const auto first = pool.Alloc();
+    const auto [id, object] = pool.Alloc();
+    object.position = {1.f, 2.f};
+    object.old_position = {3.f, 4.f};
+    object.radius = 2.f;
+    object.movable = true;
+
+    const size_t index = id.GetValue();
+    ASSERT_EQ(pool.SlotsCount(), 2U);
+    EXPECT_EQ(pool.Positions()[index].x(), 1.f);
+    EXPECT_EQ(pool.OldPositions()[index].y(), 4.f);
+    EXPECT_EQ(pool.Radii()[index], 2.f);
+    EXPECT_EQ(pool.Radii()[0], verlet::kDefaultObjectRadius);
+    EXPECT_TRUE(pool.Flags()[index].movable);
+    EXPECT_FALSE(pool.Flags()[0].movable);
+}
+
+// The live objects are found a word of slots at a time, so the ones either side of a word's
+// edge, and words with nothing live in them, are where a walk would go wrong.
+TEST(ObjectPoolTest, IdentifiersSkipFreedSlotsAcrossWords)  // NOLINT
+{
+    verlet::ObjectPool pool;
+    std::vector<verlet::ObjectId> ids;
+    for (size_t i = 0; i != 300; ++i) ids.push_back(std::get<0>(pool.Alloc()));
+
+    std::vector<verlet::ObjectId> kept;
+    for (const size_t i : {size_t{0}, size_t{63}, size_t{64}, size_t{127}, size_t{256}, size_t{299}})
+    {
+        kept.push_back(ids[i]);
+    }
+    for (const verlet::ObjectId id : ids)
+    {
+        if (std::ranges::find(kept, id) == kept.end()) pool.Free(id);
+    }
+
+    EXPECT_EQ(Identifiers(pool), kept);
+    EXPECT_FALSE(pool.IsAlive(ids[1]));
+    EXPECT_TRUE(pool.IsAlive(ids[299]));
+    EXPECT_FALSE(pool.IsAlive(verlet::ObjectId::FromValue(300)));
+
+    pool.Free(ids[299]);
+    kept.pop_back();
+    EXPECT_EQ(Identifiers(pool), kept);
+}
+
+// Reordering drops the holes and moves every object, so only the remap still knows which
+// object an old id named.
+TEST(ObjectPoolTest, ReorderFollowsTheOrderAndRemapsIds)  // NOLINT
+{
+    verlet::ObjectPool pool;
+    std::vector<verlet::ObjectId> ids;
+    for (size_t i = 0; i != 4; ++i)
+    {
+        auto [id, object] = pool.Alloc();
+        object.position = {static_cast<float>(i), 0.f};
+        ids.push_back(id);
+    }
+    pool.Free(ids[1]);
+
+    const auto remap = pool.Reorder(std::vector{ids[3], ids[0], ids[2]});
+
+    EXPECT_EQ(pool.ObjectsCount(), 3U);
+    EXPECT_EQ(pool.SlotsCount(), 3U);
+    EXPECT_FALSE(remap(ids[1]).IsValid());
+    EXPECT_EQ(remap(ids[3]).GetValue(), 0U);
+    EXPECT_EQ(remap(ids[0]).GetValue(), 1U);
+    EXPECT_EQ(remap(ids[2]).GetValue(), 2U);
+    for (const size_t i : {size_t{0}, size_t{2}, size_t{3}})
+    {
+        EXPECT_EQ(pool.Get(remap(ids[i])).position.x(), static_cast<float>(i));
+    }
+
+    // Nothing is free any more, so the next object goes after the others.
+    EXPECT_EQ(std::get<0>(pool.Alloc()).GetValue(), 3U);
+}
+
+// A dense pool hands a freed object's slot and handle out again, but not its id.
+TEST(ObjectPoolTest, DenseIdsOfFreedObjectsNameNothing)  // NOLINT
+{
+    verlet::ObjectPool pool;
+    pool.SetDenseEnabled(true);
+    const auto [freed, freed_object] = pool.Alloc();
+    pool.Free(freed);
+    const auto [id, object] = pool.Alloc();
+
+    EXPECT_NE(id, freed);
+    EXPECT_EQ(pool.IndexOf(id), 0U);
+    EXPECT_TRUE(pool.IsAlive(id));
+    EXPECT_FALSE(pool.IsAlive(freed));
+
+    object.position.x() = 5.f;
+    EXPECT_FALSE(pool.TryGet(freed).has_value());
+    ASSERT_TRUE(pool.TryGet(id).has_value());
+    EXPECT_EQ(pool.TryGet(id)->position.x(), 5.f);
+}
+
+TEST(ObjectPoolTest, CompactFillsTheHolesFromTheEnd)  // NOLINT
+{
+    verlet::ObjectPool pool;
+    pool.SetDenseEnabled(true);
+    std::vector<verlet::ObjectId> ids;
+    for (size_t i = 0; i != 6; ++i)
+    {
+        auto [id, object] = pool.Alloc();
+        object.position = {static_cast<float>(i), 0.f};
+        ids.push_back(id);
+    }
+    for (const size_t i : {size_t{5}, size_t{1}, size_t{2}}) pool.Free(ids[i]);
+
+    const auto moves = pool.Compact();
+
+    using Move = std::tuple<uint32_t, uint32_t>;
+    EXPECT_EQ(moves, (std::vector{Move{4, 1}, Move{3, 2}}));
+    EXPECT_EQ(pool.SlotsCount(), 3U);
+    EXPECT_TRUE(pool.FreeSlots().empty());
+    EXPECT_EQ(Identifiers(pool), (std::vector{ids[0], ids[4], ids[3]}));
+    for (const size_t i : {size_t{0}, size_t{3}, size_t{4}})
+    {
+        EXPECT_EQ(pool.Get(ids[i]).position.x(), static_cast<float>(i));
+    }
+}
+
+// Handles follow their objects, so a dense pool's ids need no remap.
+TEST(ObjectPoolTest, DenseReorderKeepsIds)  // NOLINT
+{
+    verlet::ObjectPool pool;
+    pool.SetDenseEnabled(true);
+    std::vector<verlet::ObjectId> ids;
+    for (size_t i = 0; i != 3; ++i)
+    {
+        auto [id, object] = pool.Alloc();
+        object.position = {static_cast<float>(i), 0.f};
+        ids.push_back(id);
+    }
+
+    const auto remap = pool.Reorder(std::vector{ids[2], ids[0], ids[1]});
+
+    EXPECT_EQ(pool.IndexOf(ids[2]), 0U);
+    for (size_t i = 0; i != ids.size(); ++i)
+    {
+        EXPECT_EQ(remap(ids[i]), ids[i]);
+        EXPECT_EQ(pool.Get(ids[i]).position.x(), static_cast<float>(i));
+    }
+}
@@ -0,0 +1,118 @@
+#include "verlet/threading/task_scheduler.hpp"
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <span>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace
+{
+constexpr auto kThreadCounts = {size_t{1}, size_t{2}, size_t{3}, size_t{8}};
+}  // namespace
+
+TEST(TaskSchedulerTest, ParallelForCoversTheRangeOnce)  // NOLINT
+{
+    for (const size_t threads_count : kThreadCounts)
+    {
+        SCOPED_TRACE(threads_count);
+        verlet::TaskScheduler scheduler{threads_count};
+        for (const size_t grain : {size_t{1}, size_t{7}, size_t{5000}})
+        {
+            SCOPED_TRACE(grain);
+            std::vector<std::atomic<int>> visits(1000);
+            scheduler.ParallelFor(
+                10,
+                visits.size(),
+                grain,
+                [&](const size_t first, const size_t last)
+                {
+                    EXPECT_LE(last - first, grain);
+                    for (size_t index = first; index != last; ++index) ++visits[index];
+                });
+
+            for (size_t index = 0; index != visits.size(); ++index)
+            {
+                EXPECT_EQ(visits[index].load(), index < 10 ? 0 : 1) << "index " << index;
+            }
+        }
+    }
+}
+
+TEST(TaskSchedulerTest, RunBatchCallsEverySliceOnce)  // NOLINT
+{
+    for (const size_t threads_count : kThreadCounts)
+    {
+        SCOPED_TRACE(threads_count);
+        verlet::TaskScheduler scheduler{threads_count};
+        std::vector<std::atomic<int>> visits(threads_count);
+        scheduler.RunBatch(
+            [&](const size_t slice, const size_t slices_count)
+            {
+                EXPECT_EQ(slices_count, threads_count);
+                ++visits[slice];
+            });
+
+        for (const auto& slice_visits : visits) EXPECT_EQ(slice_visits.load(), 1);
+    }
+}
+
+TEST(TaskSchedulerTest, TasksRunAfterTheirDependencies)  // NOLINT
+{
+    for (const size_t threads_count : kThreadCounts)
+    {
+        SCOPED_TRACE(threads_count);
+        verlet::TaskScheduler scheduler{threads_count};
+        for (size_t repeat = 0; repeat != 100; ++repeat)
+        {
+            std::mutex mutex;
+            std::vector<int> order;
+            auto append = [&](int value)
+            {
+                return [&, value]
+                {
+                    const std::lock_guard lock{mutex};
+                    order.push_back(value);
+                };
+            };
+
+            const auto first = scheduler.Submit(append(1));
+            const auto second = scheduler.Submit(append(2), std::span{&first, 1});
+            const std::array both{first, second};
+            const auto third = scheduler.Submit(append(3), both);
+            scheduler.Wait(third);
+
+            EXPECT_TRUE(first->IsDone());
+            EXPECT_TRUE(second->IsDone());
+            EXPECT_EQ(order, (std::vector{1, 2, 3}));
+        }
+    }
+}
+
+// Every thread waits for all the others, which only ends if they all run at once.
+TEST(TaskSchedulerTest, RunOnEveryThreadRunsThemAtOnce)  // NOLINT
+{
+    for (const size_t threads_count : kThreadCounts)
+    {
+        SCOPED_TRACE(threads_count);
+        verlet::TaskScheduler scheduler{threads_count};
+        for (size_t repeat = 0; repeat != 100; ++repeat)
+        {
+            std::atomic<size_t> arrived = 0;
+            std::vector<std::atomic<int>> visits(threads_count);
+            scheduler.RunOnEveryThread(
+                [&](const size_t thread_index, const size_t count)
+                {
+                    ++visits[thread_index];
+                    ++arrived;
+                    while (arrived.load() != count)
+                    {
+                    }
+                });
+
+            for (const auto& thread_visits : visits) EXPECT_EQ(thread_visits.load(), 1);
+        }
+    }
+}
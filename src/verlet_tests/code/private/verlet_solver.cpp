@@ -1,8 +1,11 @@
 #include "verlet/physics/verlet_solver.hpp"
 
+#include <numeric>
+#include <ranges>
 #include <vector>
 
 #include "gtest/gtest.h"
+#include "magic_enum/magic_enum.hpp"
 
 namespace
 {
@@ -10,12 +13,23 @@ constexpr size_t kObjectsPerSide = 40;
 constexpr float kSpacing = 0.8f;
 constexpr size_t kSteps = 200;
 
-static_assert(kSpacing < 2 * verlet::VerletObject::GetRadius());
+static_assert(kSpacing < 2 * verlet::kDefaultObjectRadius);
 
-std::vector<edt::Vec2f> Simulate(size_t threads_count, size_t steps)
+constexpr auto kBroadphases = magic_enum::enum_values<verlet::Broadphase>();
+constexpr auto kStencils = magic_enum::enum_values<verlet::CollisionStencil>();
+
+std::vector<edt::Vec2f> Simulate(
+    size_t threads_count,
+    size_t steps,
+    verlet::Broadphase broadphase = verlet::Broadphase::CellChains,
+    verlet::CollisionStencil stencil = verlet::CollisionStencil::Full,
+    verlet::CollisionIteration iteration = verlet::CollisionIteration::GaussSeidel)
 {
     verlet::VerletSolver solver;
     solver.SetThreadsCount(threads_count);
+    solver.SetBroadphase(broadphase);
+    solver.SetCollisionStencil(stencil);
+    solver.SetCollisionIteration(iteration);
 
     const auto origin = solver.GetSimArea().Min() + 10.f;
     for (size_t y = 0; y != kObjectsPerSide; ++y)
@@ -47,6 +61,92 @@ void ExpectSamePositions(const std::vector<edt::Vec2f>& expected, const std::vec
         EXPECT_EQ(expected[i].y(), actual[i].y()) << "object " << i;
     }
 }
+
+struct ChurnOptions
+{
+    verlet::Broadphase broadphase = verlet::Broadphase::CellChains;
+    bool fused_binning = false;
+    bool persistent_workers = false;
+    bool numa = false;
+    bool dense = false;
+};
+
+// A pile that loses every fifth object a quarter of the way in, has the freed slots handed out
+// again before the grid is built, and is reordered halfway. A NUMA run pins the threads and places
+// the memory by node after the respawn and at the reordering. A dense pool fills the rest of the
+// holes at the next update, and its ids outlive the reordering.
+std::vector<edt::Vec2f> SimulateChurn(const ChurnOptions& options)
+{
+    verlet::VerletSolver solver;
+    solver.SetThreadPinningEnabled(options.numa);
+    solver.SetNumaPlacementEnabled(options.numa);
+    solver.SetThreadsCount(3);
+    solver.SetBroadphase(options.broadphase);
+    solver.SetFusedBinningEnabled(options.fused_binning);
+    solver.SetPersistentWorkersEnabled(options.persistent_workers);
+    solver.objects.SetDenseEnabled(options.dense);
+
+    const auto origin = solver.GetSimArea().Min() + 10.f;
+    std::vector<verlet::ObjectId> ids;
+    auto spawn = [&](const edt::Vec2f& position)
+    {
+        auto [id, object] = solver.objects.Alloc();
+        object.position = position;
+        object.old_position = object.position;
+        object.movable = true;
+        ids.push_back(id);
+    };
+
+    for (size_t y = 0; y != kObjectsPerSide; ++y)
+    {
+        for (size_t x = 0; x != kObjectsPerSide; ++x)
+        {
+            spawn(origin + edt::Vec2f{static_cast<float>(x), static_cast<float>(y)} * kSpacing);
+        }
+    }
+
+    for (size_t step = 0; step != kSteps; ++step)
+    {
+        const auto stats = solver.Update();
+        if (options.fused_binning)
+        {
+            EXPECT_GT(stats.integrate_and_bin.count(), 0);
+        }
+        if (options.dense)
+        {
+            EXPECT_EQ(solver.objects.SlotsCount(), solver.objects.ObjectsCount());
+        }
+        if (options.persistent_workers)
+        {
+            EXPECT_EQ(solver.GetThreadBarrierWaits().size(), 3);
+            EXPECT_EQ(stats.barrier_wait, std::ranges::max(solver.GetThreadBarrierWaits()));
+        }
+        if (step == kSteps / 4)
+        {
+            for (size_t i = 0; i < ids.size(); i += 5) solver.DeleteObject(ids[i]);
+            for (size_t i = 0; i != 100; ++i) spawn(origin + edt::Vec2f{static_cast<float>(i % 20), 40.f});
+        }
+        if (options.numa && step == kSteps / 4 + 1)
+        {
+            const verlet::PagePlacement placement = solver.PlaceOnNumaNodes();
+            EXPECT_LE(placement.placed_pages, placement.pages);
+        }
+        if (step == kSteps / 2) std::ignore = solver.ReorderObjects();
+    }
+
+    if (options.dense)
+    {
+        const size_t deleted_before = kObjectsPerSide * kObjectsPerSide;
+        for (size_t i = 0; i != ids.size(); ++i)
+        {
+            EXPECT_EQ(solver.objects.IsAlive(ids[i]), i >= deleted_before || i % 5 != 0) << "object " << i;
+        }
+    }
+
+    std::vector<edt::Vec2f> positions;
+    for (const auto& object : solver.objects.Objects()) positions.push_back(object.position);
+    return positions;
+}
 }  // namespace
 
 // Gravity is straight down and every object is identical, so an object only ever leaves its
@@ -55,20 +155,28 @@ void ExpectSamePositions(const std::vector<edt::Vec2f>& expected, const std::vec
 TEST(VerletSolverTest, ObjectsCollide)  // NOLINT
 {
     const auto initial = Simulate(1, 0);
-    const auto simulated = Simulate(1, kSteps);
-    ASSERT_EQ(initial.size(), simulated.size());
-
-    size_t moved_sideways = 0;
-    float initial_width = 0, simulated_width = 0;
-    for (size_t i = 0; i != initial.size(); ++i)
+    for (const auto broadphase : kBroadphases)
     {
-        if (std::abs(initial[i].x() - simulated[i].x()) > 0.f) ++moved_sideways;
-        initial_width = std::max(initial_width, std::abs(initial[i].x() - initial.front().x()));
-        simulated_width = std::max(simulated_width, std::abs(simulated[i].x() - initial.front().x()));
-    }
+        SCOPED_TRACE(magic_enum::enum_name(broadphase));
+        for (const auto stencil : kStencils)
+        {
+            SCOPED_TRACE(magic_enum::enum_name(stencil));
+            const auto simulated = Simulate(1, kSteps, broadphase, stencil);
+            ASSERT_EQ(initial.size(), simulated.size());
+
+            size_t moved_sideways = 0;
+            float initial_width = 0, simulated_width = 0;
+            for (size_t i = 0; i != initial.size(); ++i)
+            {
+                if (std::abs(initial[i].x() - simulated[i].x()) > 0.f) ++moved_sideways;
+                initial_width = std::max(initial_width, std::abs(initial[i].x() - initial.front().x()));
+                simulated_width = std::max(simulated_width, std::abs(simulated[i].x() - initial.front().x()));
+            }
 
-    EXPECT_GT(moved_sideways, initial.size() / 2);
-    EXPECT_GT(simulated_width, initial_width);
+            EXPECT_GT(moved_sideways, initial.size() / 2);
+            EXPECT_GT(simulated_width, initial_width);
+        }
+    }
 }
 
 TEST(VerletSolverTest, RepeatedRunsMatch)  // NOLINT
@@ -78,10 +186,769 @@ TEST(VerletSolverTest, RepeatedRunsMatch)  // NOLINT
 
 TEST(VerletSolverTest, ResultIsThreadCountIndependent)  // NOLINT
 {
-    const auto single_threaded = Simulate(1, kSteps);
-    for (const size_t threads_count : {size_t{2}, size_t{3}, size_t{4}, size_t{8}, size_t{16}})
+    for (const auto broadphase : kBroadphases)
+    {
+        SCOPED_TRACE(magic_enum::enum_name(broadphase));
+        for (const auto stencil : kStencils)
+        {
+            SCOPED_TRACE(magic_enum::enum_name(stencil));
+            const auto single_threaded = Simulate(1, kSteps, broadphase, stencil);
+            for (const size_t threads_count : {size_t{2}, size_t{3}, size_t{4}, size_t{8}, size_t{16}})
+            {
+                SCOPED_TRACE(threads_count);
+                ExpectSamePositions(single_threaded, Simulate(threads_count, kSteps, broadphase, stencil));
+            }
+        }
+    }
+}
+
+// Every object sums its own corrections, in the order its tile lists its neighbours, so how
+// many threads solve the tiles changes nothing; and the pile still spreads as it falls.
+TEST(VerletSolverTest, JacobiIsThreadCountIndependent)  // NOLINT
+{
+    constexpr auto kJacobi = verlet::CollisionIteration::Jacobi;
+    constexpr auto kFull = verlet::CollisionStencil::Full;
+    const auto initial = Simulate(1, 0);
+    for (const auto broadphase : kBroadphases)
+    {
+        SCOPED_TRACE(magic_enum::enum_name(broadphase));
+        const auto single_threaded = Simulate(1, kSteps, broadphase, kFull, kJacobi);
+        EXPECT_GT(
+            std::ranges::max(single_threaded, {}, [](const edt::Vec2f& p) { return p.x(); }).x(),
+            std::ranges::max(initial, {}, [](const edt::Vec2f& p) { return p.x(); }).x());
+        for (const size_t threads_count : {size_t{3}, size_t{8}})
+        {
+            SCOPED_TRACE(threads_count);
+            ExpectSamePositions(single_threaded, Simulate(threads_count, kSteps, broadphase, kFull, kJacobi));
+        }
+    }
+}
+
+// The half stencil gathers a cell and the cells ahead of it in the same order whichever way
+// the grid lists them, and both list a cell in index order, so the broadphase makes no
+// difference to where the objects end up.
+TEST(VerletSolverTest, HalfStencilIsBroadphaseIndependent)  // NOLINT
+{
+    ExpectSamePositions(
+        Simulate(3, kSteps, verlet::Broadphase::CellChains, verlet::CollisionStencil::Half),
+        Simulate(3, kSteps, verlet::Broadphase::SortedCells, verlet::CollisionStencil::Half));
+}
+
+// Incremental chains list every cell the way rebuilt ones do, so a run gives the same result
+// under both, through deletions, slots handed out again while still chained, and reordering.
+TEST(VerletSolverTest, IncrementalChainsMatchRebuiltOnes)  // NOLINT
+{
+    ExpectSamePositions(
+        SimulateChurn({.broadphase = verlet::Broadphase::CellChains}),
+        SimulateChurn({.broadphase = verlet::Broadphase::IncrementalChains}));
+}
+
+// Binning while integrating finds the same moves the grid build would.
+TEST(VerletSolverTest, FusedBinningMatchesSeparatePasses)  // NOLINT
+{
+    ExpectSamePositions(
+        SimulateChurn({.broadphase = verlet::Broadphase::IncrementalChains}),
+        SimulateChurn({.broadphase = verlet::Broadphase::IncrementalChains, .fused_binning = true}));
+}
+
+// Persistent workers run the passes of an update in the same slices the pool's batches do.
+TEST(VerletSolverTest, PersistentWorkersMatchBatches)  // NOLINT
+{
+    for (const auto broadphase : kBroadphases)
+    {
+        SCOPED_TRACE(magic_enum::enum_name(broadphase));
+        ExpectSamePositions(
+            SimulateChurn({.broadphase = broadphase}),
+            SimulateChurn({.broadphase = broadphase, .persistent_workers = true}));
+    }
+}
+
+// Where the pages of the solver live and which cores its threads run on change how fast it
+// is, not what it computes.
+TEST(VerletSolverTest, NumaPlacementKeepsResults)  // NOLINT
+{
+    ExpectSamePositions(
+        SimulateChurn({.persistent_workers = true}),
+        SimulateChurn({.persistent_workers = true, .numa = true}));
+}
+
+// Compacting a dense pool moves a few objects to other slots, and the incremental chains follow
+// them there rather than being built anew, which has to end up where a full build would.
+TEST(VerletSolverTest, DensePoolChainsFollowTheMovedObjects)  // NOLINT
+{
+    ExpectSamePositions(
+        SimulateChurn({.dense = true}),
+        SimulateChurn({.broadphase = verlet::Broadphase::IncrementalChains, .dense = true}));
+}
+
+// However many threads build the grid, every cell lists its objects in index order.
+TEST(VerletSolverTest, CellsListObjectsInIndexOrder)  // NOLINT
+{
+    for (const auto broadphase : kBroadphases)
+    {
+        SCOPED_TRACE(magic_enum::enum_name(broadphase));
+        for (const size_t threads_count : {size_t{1}, size_t{3}, size_t{8}})
+        {
+            SCOPED_TRACE(threads_count);
+            verlet::VerletSolver solver;
+            solver.SetThreadsCount(threads_count);
+            solver.SetBroadphase(broadphase);
+
+            // Objects in a cell come from every part of the pool, and a few slots are left free.
+            const auto origin = solver.GetSimArea().Min() + 10.5f;
+            std::vector<verlet::ObjectId> ids;
+            for (size_t i = 0; i != 60; ++i)
+            {
+                auto [id, object] = solver.objects.Alloc();
+                object.position = origin + edt::Vec2f{static_cast<float>(i % 4), 0.f};
+                ids.push_back(id);
+            }
+            for (size_t i = 0; i < ids.size(); i += 7) solver.objects.Free(ids[i]);
+            solver.RebuildGrid();
+
+            for (size_t x = 0; x != 4; ++x)
+            {
+                std::vector<size_t> expected;
+                for (size_t i = x; i < ids.size(); i += 4)
+                {
+                    if (i % 7 != 0) expected.push_back(ids[i].GetValue());
+                }
+
+                std::vector<size_t> actual;
+                const auto cell = solver.LocationToCellIndex(origin + edt::Vec2f{static_cast<float>(x), 0.f});
+                for (const uint32_t index : solver.ForEachIndexInCell(cell)) actual.push_back(index);
+                EXPECT_EQ(expected, actual) << "column " << x;
+            }
+        }
+    }
+}
+
+// Switching the broadphase in the middle of a run rebuilds the grid in the new layout, so the
+// next step sees every object whichever layout it was binned in before.
+TEST(VerletSolverTest, SwitchingBroadphaseKeepsCollisions)  // NOLINT
+{
+    verlet::VerletSolver solver;
+    const auto origin = solver.GetSimArea().Min() + 10.5f;
+    std::vector<verlet::ObjectId> ids;
+    for (const float x : {0.f, 0.5f})
+    {
+        auto [id, object] = solver.objects.Alloc();
+        object.position = origin + edt::Vec2f{x, 0.f};
+        object.old_position = object.position;
+        object.movable = true;
+        ids.push_back(id);
+    }
+
+    std::ignore = solver.Update();
+    solver.SetBroadphase(verlet::Broadphase::SortedCells);
+    EXPECT_EQ(solver.GetBroadphase(), verlet::Broadphase::SortedCells);
+    std::ignore = solver.Update();
+
+    const auto distance = solver.objects.Get(ids[1]).position - solver.objects.Get(ids[0]).position;
+    EXPECT_GT(distance.x(), 0.5f);
+}
+
+// Objects spawned far apart in the world but next to each other in the pool end up apart,
+// and objects in one cell end up next to each other, whatever order they were spawned in.
+TEST(VerletSolverTest, ReorderStoresObjectsAlongTheGrid)  // NOLINT
+{
+    verlet::VerletSolver solver;
+    const auto origin = solver.GetSimArea().Min() + 10.5f;
+    const std::vector<edt::Vec2f> offsets{{50, 50}, {0, 0}, {50, 50.25f}, {0, 0.25f}};
+
+    std::vector<verlet::ObjectId> ids;
+    for (const auto& offset : offsets)
+    {
+        auto [id, object] = solver.objects.Alloc();
+        object.position = origin + offset;
+        object.old_position = object.position;
+        ids.push_back(id);
+    }
+
+    const auto remap = solver.ReorderObjects();
+
+    EXPECT_EQ(remap(ids[1]).GetValue(), 0U);
+    EXPECT_EQ(remap(ids[3]).GetValue(), 1U);
+    EXPECT_EQ(remap(ids[0]).GetValue(), 2U);
+    EXPECT_EQ(remap(ids[2]).GetValue(), 3U);
+    for (size_t i = 0; i != ids.size(); ++i)
+    {
+        EXPECT_EQ(solver.objects.Get(remap(ids[i])).position, origin + offsets[i]);
+    }
+}
+
+// Reordering only changes where objects are stored, so a chain keeps its links through it.
+TEST(VerletSolverTest, ReorderKeepsLinks)  // NOLINT
+{
+    verlet::VerletSolver solver;
+    const auto origin = solver.GetSimArea().Min() + 50.f;
+
+    std::vector<verlet::ObjectId> ids;
+    for (size_t i = 0; i != 2; ++i)
+    {
+        auto [id, object] = solver.objects.Alloc();
+        object.position = origin + edt::Vec2f{40.f * static_cast<float>(1 - i), 0.f};
+        object.old_position = object.position;
+        object.movable = i == 0;
+        ids.push_back(id);
+    }
+    solver.CreateLink(ids[0], ids[1], 3.f);
+
+    const auto remap = solver.ReorderObjects();
+    ASSERT_NE(remap(ids[0]), ids[0]);
+    solver.ApplyLinks();
+
+    const auto distance = (solver.objects.Get(remap(ids[0])).position - solver.objects.Get(remap(ids[1])).position);
+    EXPECT_NEAR(distance.Length(), 3.f, 1e-4f);
+}
+
+namespace
+{
+// Drops a block of objects into a box that holds it from the sides, so that it cannot keep
+// spreading out, and runs the solver with sleeping on until it has long settled.
+std::vector<verlet::ObjectId> SettlePile(verlet::VerletSolver& solver)
+{
+    solver.SetSleepingEnabled(true);
+    solver.SetSimArea({.x = {.begin = -12, .end = 12}, .y = {.begin = -12, .end = 24}});
+    std::vector<verlet::ObjectId> ids;
+    const auto origin = edt::Vec2f{-9.5f, -9.f};
+    for (size_t y = 0; y != 10; ++y)
+    {
+        for (size_t x = 0; x != 20; ++x)
+        {
+            auto [id, object] = solver.objects.Alloc();
+            object.position = origin + edt::Vec2f{static_cast<float>(x), static_cast<float>(y)};
+            object.old_position = object.position;
+            object.movable = true;
+            ids.push_back(id);
+        }
+    }
+
+    for (size_t step = 0; step != 600; ++step) std::ignore = solver.Update();
+    return ids;
+}
+}  // namespace
+
+TEST(VerletSolverTest, SettledPileFallsAsleep)  // NOLINT
+{
+    verlet::VerletSolver solver;
+    const auto ids = SettlePile(solver);
+    std::vector<edt::Vec2f> positions;
+    for (const auto& id : ids) positions.push_back(solver.objects.Get(id).position);
+
+    EXPECT_EQ(solver.Update().sleeping_objects, ids.size());
+    for (size_t i = 0; i != ids.size(); ++i) EXPECT_EQ(solver.objects.Get(ids[i]).position, positions[i]);
+
+    solver.SetSleepingEnabled(false);
+    EXPECT_EQ(solver.Update().sleeping_objects, 0U);
+}
+
+// A sleeping tile has to wake for an object spawned into it, and its objects have to stop the
+// object on top of the pile rather than let it sink in.
+TEST(VerletSolverTest, SleepingPileHoldsUpAFallingObject)  // NOLINT
+{
+    verlet::VerletSolver solver;
+    const auto ids = SettlePile(solver);
+    float pile_top = solver.GetSimArea().Min().y();
+    for (const auto& id : ids) pile_top = std::max(pile_top, solver.objects.Get(id).position.y());
+
+    auto [dropped_id, dropped] = solver.objects.Alloc();
+    dropped.position = solver.objects.Get(ids[ids.size() - 5]).position + edt::Vec2f{0.1f, 3.f};
+    dropped.old_position = dropped.position;
+    dropped.movable = true;
+
+    for (size_t step = 0; step != 120; ++step) std::ignore = solver.Update();
+    EXPECT_GT(solver.objects.Get(dropped_id).position.y(), pile_top);
+}
+
+// Binning while integrating has to leave the chains of sleeping tiles alone the way the grid
+// build does, through the pile falling asleep and being woken by an object dropped onto it.
+TEST(VerletSolverTest, FusedBinningMatchesSeparatePassesWhileSleeping)  // NOLINT
+{
+    auto simulate = [](const bool fused_binning)
+    {
+        verlet::VerletSolver solver;
+        solver.SetThreadsCount(3);
+        solver.SetBroadphase(verlet::Broadphase::IncrementalChains);
+        solver.SetFusedBinningEnabled(fused_binning);
+        const auto ids = SettlePile(solver);
+        EXPECT_EQ(solver.Update().sleeping_objects, ids.size());
+
+        auto [dropped_id, dropped] = solver.objects.Alloc();
+        dropped.position = solver.objects.Get(ids[ids.size() - 5]).position + edt::Vec2f{0.1f, 3.f};
+        dropped.old_position = dropped.position;
+        dropped.movable = true;
+        for (size_t step = 0; step != 120; ++step) std::ignore = solver.Update();
+
+        std::vector<edt::Vec2f> positions;
+        for (const auto& object : solver.objects.Objects()) positions.push_back(object.position);
+        return positions;
+    };
+
+    ExpectSamePositions(simulate(false), simulate(true));
+}
+
+// Tools that move objects by hand have to wake the tiles they touched.
+TEST(VerletSolverTest, WakeAreaWakesTheTilesAround)  // NOLINT
+{
+    verlet::VerletSolver solver;
+    const auto ids = SettlePile(solver);
+    ASSERT_EQ(solver.Update().sleeping_objects, ids.size());
+
+    solver.WakeArea(solver.objects.Get(ids[0]).position, 1.f);
+    EXPECT_LT(solver.Update().sleeping_objects, ids.size());
+}
+
+// A world many times larger than the part of it that holds objects only ever builds and walks
+// the tiles with objects in them, and what happens there is the same as in a small world.
+TEST(VerletSolverTest, SparseWorldMatchesSmallWorld)  // NOLINT
+{
+    auto simulate = [](const edt::FloatRange2Df& sim_area, const verlet::Broadphase broadphase)
+    {
+        verlet::VerletSolver solver;
+        solver.SetThreadsCount(3);
+        solver.SetBroadphase(broadphase);
+        solver.SetSimArea(sim_area);
+
+        const auto origin = sim_area.Min() + edt::Vec2f{10.f, 30.f};
+        for (size_t y = 0; y != 10; ++y)
+        {
+            for (size_t x = 0; x != 10; ++x)
+            {
+                auto [id, object] = solver.objects.Alloc();
+                std::ignore = id;
+                object.position = origin + edt::Vec2f{static_cast<float>(x), static_cast<float>(y)};
+                object.old_position = object.position;
+                object.movable = true;
+            }
+        }
+
+        // The block falls through several rows of tiles, leaving each of them empty behind it.
+        for (size_t step = 0; step != kSteps; ++step) std::ignore = solver.Update();
+
+        std::vector<edt::Vec2f> positions;
+        for (const auto& object : solver.objects.Objects()) positions.push_back(object.position - sim_area.Min());
+        return positions;
+    };
+
+    for (const auto broadphase : kBroadphases)
+    {
+        SCOPED_TRACE(magic_enum::enum_name(broadphase));
+        ExpectSamePositions(
+            simulate({.x = {.begin = -20, .end = 200}, .y = {.begin = -20, .end = 60}}, broadphase),
+            simulate({.x = {.begin = -20, .end = 4000}, .y = {.begin = -20, .end = 2000}}, broadphase));
+    }
+}
+
+namespace
+{
+// A bed of small objects with a few too big for a cell dropped into it, of two sizes, so that
+// they land on small objects, on each other, and on objects of another level.
+std::vector<edt::Vec2f> SimulateMixedSizes(size_t threads_count, verlet::Broadphase broadphase)
+{
+    verlet::VerletSolver solver;
+    solver.SetThreadsCount(threads_count);
+    solver.SetBroadphase(broadphase);
+    solver.SetSimArea({.x = {.begin = -30, .end = 30}, .y = {.begin = -30, .end = 60}});
+
+    for (size_t y = 0; y != 10; ++y)
+    {
+        for (size_t x = 0; x != 50; ++x)
+        {
+            auto [id, object] = solver.objects.Alloc();
+            std::ignore = id;
+            object.position = edt::Vec2f{-25.f + static_cast<float>(x), -27.f + static_cast<float>(y)};
+            object.old_position = object.position;
+            object.movable = true;
+        }
+    }
+
+    for (size_t i = 0; i != 6; ++i)
+    {
+        auto [id, object] = solver.objects.Alloc();
+        std::ignore = id;
+        object.position = edt::Vec2f{-20.f + 7.f * static_cast<float>(i), 10.f + 4.f * static_cast<float>(i % 2)};
+        object.old_position = object.position;
+        object.radius = i % 2 == 0 ? 1.5f : 3.f;
+        object.movable = true;
+    }
+
+    for (size_t step = 0; step != kSteps; ++step) std::ignore = solver.Update();
+
+    std::vector<edt::Vec2f> positions;
+    for (const auto& object : solver.objects.Objects()) positions.push_back(object.position);
+    return positions;
+}
+}  // namespace
+
+// A packed pile in one corner and a sprinkling everywhere else: an even split of the tiles
+// would hand the pile to one or two threads, so the tiles are split by their objects instead.
+// A run of whole tiles can be off its share by at most the objects of one tile.
+TEST(VerletSolverTest, CollisionWorkIsSplitEvenlyOverThreads)  // NOLINT
+{
+    verlet::VerletSolver solver;
+    solver.SetSimArea({.x = {.begin = -100, .end = 100}, .y = {.begin = -100, .end = 100}});
+    auto spawn = [&](const edt::Vec2f& position)
+    {
+        auto [id, object] = solver.objects.Alloc();
+        std::ignore = id;
+        object.position = position;
+        object.old_position = position;
+        object.movable = true;
+    };
+
+    for (size_t y = 0; y != 96; ++y)
+    {
+        for (size_t x = 0; x != 96; ++x)
+        {
+            spawn(edt::Vec2f{-95.5f, -95.5f} + edt::Vec2f{static_cast<float>(x), static_cast<float>(y)});
+        }
+    }
+    for (size_t y = 0; y != 38; ++y)
+    {
+        for (size_t x = 0; x != 19; ++x)
+        {
+            spawn(edt::Vec2f{5.5f, -95.5f} + edt::Vec2f{static_cast<float>(x), static_cast<float>(y)} * 5.f);
+        }
+    }
+
+    std::ignore = solver.Update();
+
+    constexpr auto kTileObjects = verlet::VerletSolver::kCollisionTileSize * verlet::VerletSolver::kCollisionTileSize;
+    for (const size_t threads_count : {size_t{2}, size_t{3}, size_t{4}, size_t{8}})
+    {
+        for (const size_t color : std::views::iota(size_t{0}, verlet::VerletSolver::kCollisionTileColors))
+        {
+            SCOPED_TRACE(testing::Message() << threads_count << " threads, color " << color);
+            const auto split = solver.GetCollisionWorkSplit(color, threads_count);
+            ASSERT_EQ(split.size(), threads_count);
+
+            const uint64_t total = std::accumulate(split.begin(), split.end(), uint64_t{0});
+            ASSERT_GT(total, threads_count * kTileObjects);
+            const double share = static_cast<double>(total) / static_cast<double>(threads_count);
+            for (const uint64_t work : split) EXPECT_NEAR(static_cast<double>(work), share, kTileObjects);
+        }
+    }
+}
+
+TEST(VerletSolverTest, MixedSizesAreThreadCountIndependent)  // NOLINT
+{
+    for (const auto broadphase : kBroadphases)
+    {
+        SCOPED_TRACE(magic_enum::enum_name(broadphase));
+        const auto single_threaded = SimulateMixedSizes(1, broadphase);
+        for (const size_t threads_count : {size_t{3}, size_t{8}})
+        {
+            SCOPED_TRACE(threads_count);
+            ExpectSamePositions(single_threaded, SimulateMixedSizes(threads_count, broadphase));
+        }
+    }
+}
+
+// Objects too big for a cell are kept out of the cells, but still land on the small objects
+// rather than sinking through them, and are listed for the tools.
+TEST(VerletSolverTest, BigObjectRestsOnSmallOnes)  // NOLINT
+{
+    verlet::VerletSolver solver;
+    solver.SetSimArea({.x = {.begin = -20, .end = 20}, .y = {.begin = -12, .end = 40}});
+    for (size_t x = 0; x != 30; ++x)
+    {
+        auto [id, object] = solver.objects.Alloc();
+        std::ignore = id;
+        object.position = edt::Vec2f{-15.f + static_cast<float>(x), -9.5f};
+        object.old_position = object.position;
+    }
+
+    auto [big_id, big] = solver.objects.Alloc();
+    big.position = edt::Vec2f{0.3f, 10.f};
+    big.old_position = big.position;
+    big.radius = 4.f;
+    big.movable = true;
+
+    for (size_t step = 0; step != kSteps; ++step) std::ignore = solver.Update();
+
+    EXPECT_NEAR(solver.objects.Get(big_id).position.y(), -9.5f + 0.5f + 4.f, 0.1f);
+    EXPECT_EQ(std::ranges::distance(solver.ForEachCoarseObject()), 1);
+    EXPECT_EQ(*solver.ForEachCoarseObject().begin(), big_id);
+}
+
+// A frame of several substeps does what as many frames of one substep each do over the same
+// time, whether the count has a build of its own or takes the generic one. The time step is a
+// power of two, so that a substep's share of it is exact.
+TEST(VerletSolverTest, FrameIsItsSubSteps)  // NOLINT
+{
+    auto simulate = [](const size_t substeps, const size_t frames)
+    {
+        verlet::VerletSolver solver;
+        solver.SetSleepingEnabled(false);
+        auto config = solver.GetConfig();
+        config.substeps = substeps;
+        config.time_step_seconds = static_cast<float>(substeps) / 64.f;
+        solver.SetConfig(config);
+
+        const auto origin = solver.GetSimArea().Min() + 10.f;
+        for (size_t y = 0; y != 20; ++y)
+        {
+            for (size_t x = 0; x != 20; ++x)
+            {
+                auto [id, object] = solver.objects.Alloc();
+                std::ignore = id;
+                object.position = origin + edt::Vec2f{static_cast<float>(x), static_cast<float>(y)} * kSpacing;
+                object.old_position = object.position;
+                object.movable = true;
+            }
+        }
+
+        for (size_t frame = 0; frame != frames; ++frame) std::ignore = solver.Update();
+
+        std::vector<edt::Vec2f> positions;
+        for (const auto& object : solver.objects.Objects()) positions.push_back(object.position);
+        return positions;
+    };
+
+    constexpr size_t kSubStepsTotal = 24;
+    const auto expected = simulate(1, kSubStepsTotal);
+    for (const size_t substeps : {size_t{2}, size_t{3}, size_t{4}, size_t{8}})
+    {
+        SCOPED_TRACE(substeps);
+        ExpectSamePositions(expected, simulate(substeps, kSubStepsTotal / substeps));
+    }
+}
+
+// Wider cells hold bigger objects, and the grid is rebuilt for them at once. A pile asleep
+// under one gravity wakes when it changes, and without damping slides the new way.
+TEST(VerletSolverTest, ConfigChangesTakeEffect)  // NOLINT
+{
+    verlet::VerletSolver solver;
+    const auto ids = SettlePile(solver);
+    ASSERT_EQ(solver.Update().sleeping_objects, ids.size());
+    const size_t cells_count = solver.GetGridCellsCount();
+
+    auto config = solver.GetConfig();
+    config.cell_size = 2.f;
+    config.gravity = edt::Vec2f{-20.f, 0.f};
+    config.velocity_damping = 0.f;
+    solver.SetConfig(config);
+    EXPECT_LT(solver.GetGridCellsCount(), cells_count / 3);
+    EXPECT_EQ(solver.GetMaxCellObjectRadius(), 1.f);
+
+    auto [big_id, big] = solver.objects.Alloc();
+    big.position = edt::Vec2f{0.f, 20.f};
+    big.old_position = big.position;
+    big.radius = 1.f;
+
+    const float left_before = solver.objects.Get(ids.back()).position.x();
+    EXPECT_EQ(solver.Update().sleeping_objects, 0U);
+    EXPECT_EQ(std::ranges::distance(solver.ForEachCoarseObject()), 0);
+    for (size_t step = 0; step != 60; ++step) std::ignore = solver.Update();
+    EXPECT_LT(solver.objects.Get(ids.back()).position.x(), left_before - 1.f);
+}
+
+// Adaptive substeps come down to the fewest for a row resting on the floor, and go up as soon
+// as something moves fast, by as much as it takes to keep each substep's move small.
+TEST(VerletSolverTest, AdaptiveSubStepsFollowTheFastestObject)  // NOLINT
+{
+    verlet::VerletSolver solver;
+    solver.SetSleepingEnabled(false);
+    solver.SetSimArea({.x = {.begin = -20, .end = 20}, .y = {.begin = -12, .end = 40}});
+    for (size_t x = 0; x != 30; ++x)
+    {
+        auto [id, object] = solver.objects.Alloc();
+        std::ignore = id;
+        object.position = edt::Vec2f{-15.f + static_cast<float>(x), -9.5f};
+        object.old_position = object.position;
+        object.movable = true;
+    }
+
+    EXPECT_EQ(solver.Update().substeps, solver.GetConfig().substeps);
+
+    auto config = solver.GetConfig();
+    config.adaptive_substeps = true;
+    solver.SetConfig(config);
+    for (size_t step = 0; step != 10; ++step) std::ignore = solver.Update();
+    EXPECT_EQ(solver.Update().substeps, config.min_substeps);
+
+    // One unit a frame is eight times what a substep may move.
+    auto [fast_id, fast] = solver.objects.Alloc();
+    std::ignore = fast_id;
+    fast.position = edt::Vec2f{0.f, 30.f};
+    fast.old_position = fast.position + edt::Vec2f{0.f, 1.f};
+    fast.movable = true;
+
+    std::ignore = solver.Update();
+    EXPECT_EQ(solver.GetSubStepsCount(), 8U);
+    EXPECT_EQ(solver.Update().substeps, 8U);
+}
+
+namespace
+{
+// A cloth hanging from its top row, every knot linked to the one right of it and the one
+// below, enough links that every color of them is split among the threads.
+std::vector<edt::Vec2f>
+SimulateCloth(size_t threads_count, const verlet::SolverConfig& config = {}, bool persistent_workers = false)
+{
+    constexpr size_t kKnotsPerSide = 40;
+    verlet::VerletSolver solver;
+    solver.SetConfig(config);
+    solver.SetThreadsCount(threads_count);
+    solver.SetPersistentWorkersEnabled(persistent_workers);
+    solver.SetSimArea({.x = {.begin = -40, .end = 40}, .y = {.begin = -80, .end = 20}});
+
+    std::vector<verlet::ObjectId> ids;
+    for (size_t y = 0; y != kKnotsPerSide; ++y)
+    {
+        for (size_t x = 0; x != kKnotsPerSide; ++x)
+        {
+            auto [id, object] = solver.objects.Alloc();
+            object.position = edt::Vec2f{static_cast<float>(x) - 20.f, 10.f - static_cast<float>(y)} * 1.2f;
+            object.old_position = object.position;
+            object.movable = y != 0;
+            ids.push_back(id);
+        }
+    }
+
+    for (size_t y = 0; y != kKnotsPerSide; ++y)
+    {
+        for (size_t x = 0; x != kKnotsPerSide; ++x)
+        {
+            const size_t knot = y * kKnotsPerSide + x;
+            if (x + 1 != kKnotsPerSide) solver.CreateLink(ids[knot], ids[knot + 1], 1.2f);
+            if (y + 1 != kKnotsPerSide) solver.CreateLink(ids[knot], ids[knot + kKnotsPerSide], 1.2f);
+        }
+    }
+
+    for (size_t step = 0; step != 60; ++step) std::ignore = solver.Update();
+
+    std::vector<edt::Vec2f> positions;
+    for (const auto& object : solver.objects.Objects()) positions.push_back(object.position);
+    return positions;
+}
+
+// How long a rope of 60 links hanging from its top knot has grown by the time it settles, as a
+// share of its length at rest.
+float HangRope(verlet::LinkModel link_model, size_t link_iterations, float link_compliance)
+{
+    constexpr size_t kLinks = 60;
+    verlet::VerletSolver solver;
+    auto config = solver.GetConfig();
+    config.link_model = link_model;
+    config.link_iterations = link_iterations;
+    config.link_compliance = link_compliance;
+    solver.SetConfig(config);
+    solver.SetSimArea({.x = {.begin = -10, .end = 10}, .y = {.begin = -100, .end = 10}});
+
+    std::vector<verlet::ObjectId> knots;
+    for (size_t knot = 0; knot != kLinks + 1; ++knot)
+    {
+        auto [id, object] = solver.objects.Alloc();
+        object.position = edt::Vec2f{0.f, -static_cast<float>(knot)};
+        object.old_position = object.position;
+        object.movable = knot != 0;
+        if (!knots.empty()) solver.CreateLink(knots.back(), id, 1.f);
+        knots.push_back(id);
+    }
+
+    for (size_t step = 0; step != 120; ++step) std::ignore = solver.Update();
+
+    const auto top = solver.objects.Get(knots.front()).position;
+    const auto bottom = solver.objects.Get(knots.back()).position;
+    return (top.y() - bottom.y()) / kLinks;
+}
+}  // namespace
+
+// Links that share no object are solved at once, so how many threads split them changes
+// nothing, and the cloth still holds together.
+TEST(VerletSolverTest, LinksAreThreadCountIndependent)  // NOLINT
+{
+    const auto single_threaded = SimulateCloth(1);
+    EXPECT_LT(std::abs(single_threaded[1].x() - single_threaded[0].x()), 1.3f);
+    EXPECT_LT(single_threaded.back().y(), single_threaded.front().y() - 40.f);
+    for (const size_t threads_count : {size_t{3}, size_t{8}})
     {
         SCOPED_TRACE(threads_count);
-        ExpectSamePositions(single_threaded, Simulate(threads_count, kSteps));
+        ExpectSamePositions(single_threaded, SimulateCloth(threads_count));
+        ExpectSamePositions(single_threaded, SimulateCloth(threads_count, {}, true));
     }
 }
+
+// A deleted object takes its links with it, and the object that later takes its slot is not
+// held by them.
+TEST(VerletSolverTest, DeletingAnObjectDropsItsLinks)  // NOLINT
+{
+    verlet::VerletSolver solver;
+    std::vector<verlet::ObjectId> ids;
+    for (size_t i = 0; i != 3; ++i)
+    {
+        auto [id, object] = solver.objects.Alloc();
+        object.position = edt::Vec2f{static_cast<float>(i), 0.f};
+        object.old_position = object.position;
+        object.movable = true;
+        ids.push_back(id);
+    }
+    solver.CreateLink(ids[0], ids[1], 5.f);
+    solver.CreateLink(ids[1], ids[2], 5.f);
+    solver.CreateLink(ids[0], ids[2], 2.f);
+
+    solver.DeleteObject(ids[1]);
+    auto [new_id, new_object] = solver.objects.Alloc();
+    new_object.position = edt::Vec2f{50.f, 0.f};
+    new_object.old_position = new_object.position;
+    new_object.movable = true;
+    ASSERT_EQ(new_id.GetValue(), ids[1].GetValue());
+
+    solver.ApplyLinks();
+    EXPECT_EQ(solver.objects.Get(new_id).position, edt::Vec2f(50.f, 0.f));
+    const auto distance = solver.objects.Get(ids[2]).position - solver.objects.Get(ids[0]).position;
+    EXPECT_FLOAT_EQ(distance.Length(), 2.f);
+}
+
+// The last object of a dense pool moves into the slot of a deleted one at the next update, and
+// its links go with it.
+TEST(VerletSolverTest, CompactingMovesLinksWithTheirObjects)  // NOLINT
+{
+    verlet::VerletSolver solver;
+    solver.objects.SetDenseEnabled(true);
+    std::vector<verlet::ObjectId> ids;
+    for (const float x : {0.f, 10.f, 20.f, 5.f})
+    {
+        auto [id, object] = solver.objects.Alloc();
+        object.position = edt::Vec2f{x, 0.f};
+        object.old_position = object.position;
+        object.movable = true;
+        ids.push_back(id);
+    }
+    solver.CreateLink(ids[0], ids[3], 2.f);
+    solver.CreateLink(ids[1], ids[2], 10.f);
+
+    solver.DeleteObject(ids[1]);
+    std::ignore = solver.Update();
+
+    ASSERT_EQ(solver.objects.SlotsCount(), 3U);
+    EXPECT_EQ(solver.objects.IndexOf(ids[3]), 1U);
+    EXPECT_FALSE(solver.objects.IsAlive(ids[1]));
+    const auto distance = solver.objects.Get(ids[3]).position - solver.objects.Get(ids[0]).position;
+    EXPECT_NEAR(distance.Length(), 2.f, 1e-3f);
+    EXPECT_EQ(solver.objects.Get(ids[2]).position.x(), 20.f);
+}
+
+// With objects of one size a rigid link's share of the push adds up to exactly one, so a single
+// iteration of the compliant model moves them bit for bit as the positional one does.
+TEST(VerletSolverTest, RigidXpbdLinksMatchPositionalOnes)  // NOLINT
+{
+    verlet::SolverConfig config;
+    config.link_model = verlet::LinkModel::Xpbd;
+    ExpectSamePositions(SimulateCloth(1), SimulateCloth(1, config));
+}
+
+// A rope stretches under its own weight as far as its links let it: less the more often they
+// are solved, more the more compliant they are.
+TEST(VerletSolverTest, LinkIterationsAndComplianceSetRopeStiffness)  // NOLINT
+{
+    const float positional = HangRope(verlet::LinkModel::Positional, 1, 0.f);
+    const float rigid = HangRope(verlet::LinkModel::Xpbd, 1, 0.f);
+    const float iterated = HangRope(verlet::LinkModel::Xpbd, 8, 0.f);
+    const float compliant = HangRope(verlet::LinkModel::Xpbd, 8, 1e-3f);
+    EXPECT_FLOAT_EQ(rigid, positional);
+    EXPECT_LT(iterated, rigid);
+    EXPECT_GT(compliant, iterated);
+}